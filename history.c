@@ -0,0 +1,698 @@
+#include "history.h"
+#include "task.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+
+#define MAX_SEGMENTS 1024
+#define RUN_PREFIX "] Ran task #"
+// "[YYYY-MM-DD HH:MM:SS" comes before the prefix
+#define TIMESTAMP_LEN 20
+
+// Duration histogram: exact below 128 ms, then 64 buckets per power of two (~1.6% error).
+// Keeps memory per task fixed no matter how many runs the logs hold.
+#define EXACT_BUCKETS 128
+#define SUB_BUCKETS 64
+#define DURATION_BUCKETS (EXACT_BUCKETS + 25 * SUB_BUCKETS)
+
+// Runs are logged when they finish, so a line can come after lines of later hours. Runs per
+// hour are counted for this many recent hours, enough for runs that take up to a few hours.
+#define RECENT_HOURS 8
+
+// A log file mapped into memory
+typedef struct {
+    const char *data;
+    size_t size;
+} Segment;
+
+// Aggregates for one task id
+typedef struct {
+    int task_id;
+    long runs;
+    long with_status;
+    long failures;
+    // Histogram of run times, allocated on the first run with a duration
+    uint32_t *durations;
+    long duration_count;
+    uint32_t min_duration;
+    uint32_t max_duration;
+    char command[41];
+} TaskStats;
+
+// Open addressing hash table of stats by task id, size is always a power of 2.
+// Slots without runs are empty. Ids come from the log, so they can be anything up to INT_MAX.
+typedef struct {
+    TaskStats *slots;
+    int size;
+    int used;
+} StatsTable;
+
+
+// Parse a fixed number of digits, returns -1 if any aren't digits
+static long parse_digits(const char *str, int count) {
+    long value = 0;
+    for (int i = 0; i < count; i++) {
+        if (str[i] < '0' || str[i] > '9') {
+            return -1;
+        }
+        value = value * 10 + (str[i] - '0');
+    }
+    return value;
+}
+
+
+// Days since 1970-01-01 for a calendar date (avoids calling mktime per line)
+static long days_from_civil(long year, long month, long day) {
+    year -= month <= 2;
+    long era = (year >= 0 ? year : year - 399) / 400;
+    long year_of_era = year - era * 400;
+    long day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+
+// Parse a decimal number at pos, moving pos past it. Returns -1 if there is none.
+static long parse_number(const char *line, size_t len, size_t *pos) {
+    size_t start = *pos;
+    long value = 0;
+    while (*pos < len && line[*pos] >= '0' && line[*pos] <= '9' && *pos - start < 18) {
+        value = value * 10 + (line[*pos] - '0');
+        (*pos)++;
+    }
+    return *pos == start ? -1 : value;
+}
+
+
+int parse_log_line(const char *line, size_t len, LogRecord *record) {
+    size_t prefix_len = strlen(RUN_PREFIX);
+    if (len < TIMESTAMP_LEN + prefix_len + 1 || line[0] != '[' ||
+        memcmp(line + TIMESTAMP_LEN, RUN_PREFIX, prefix_len) != 0) {
+        return -1;
+    }
+
+    long year = parse_digits(line + 1, 4);
+    long month = parse_digits(line + 6, 2);
+    long day = parse_digits(line + 9, 2);
+    long hour = parse_digits(line + 12, 2);
+    // flux never logged a run before 1970, & the hour count must not go negative
+    if (year < 1970 || month < 1 || month > 12 || day < 1 || day > 31 || hour < 0 || hour > 23) {
+        return -1;
+    }
+    record->hour = days_from_civil(year, month, day) * 24 + hour;
+
+    size_t pos = TIMESTAMP_LEN + prefix_len;
+    long id = parse_number(line, len, &pos);
+    if (id < 0 || id > 0x7fffffff) {
+        return -1;
+    }
+    record->task_id = (int)id;
+    record->status = STATUS_NONE;
+    record->duration_ms = -1;
+
+    // Newer lines look like "#3 (exit 0, 12 ms): cmd", older ones like "#3: cmd"
+    const char *meta = " (exit ";
+    size_t meta_len = strlen(meta);
+    if (pos + meta_len <= len && memcmp(line + pos, meta, meta_len) == 0) {
+        pos += meta_len;
+        long status = parse_number(line, len, &pos);
+        if (status < 0 || status > 0xffff || pos + 2 > len || memcmp(line + pos, ", ", 2) != 0) {
+            return -1;
+        }
+        pos += 2;
+        long duration = parse_number(line, len, &pos);
+        if (duration < 0 || pos + 4 > len || memcmp(line + pos, " ms)", 4) != 0) {
+            return -1;
+        }
+        pos += 4;
+        record->status = (int)status;
+        record->duration_ms = duration;
+    }
+
+    if (pos + 2 > len || line[pos] != ':' || line[pos + 1] != ' ') {
+        return -1;
+    }
+    pos += 2;
+    record->command = line + pos;
+    record->command_len = len - pos;
+    return 0;
+}
+
+
+// Map a whole file read-only, returns 0 on success. Empty files map to a NULL segment.
+static int map_segment(const char *filename, Segment *segment) {
+    segment->data = NULL;
+    segment->size = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+
+    // Logs are read front to back once, let the kernel read ahead aggressively
+    posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    segment->data = data;
+    segment->size = (size_t)st.st_size;
+    return 0;
+}
+
+
+static void unmap_segment(Segment *segment) {
+    if (segment->data != NULL) {
+        munmap((void *)segment->data, segment->size);
+    }
+}
+
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+
+// Get archived log file names (oldest first), returns how many were found
+static int list_archives(char **names, int max_names) {
+    DIR *dir = opendir(ARCHIVE_DIR);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && count < max_names) {
+        size_t len = strlen(entry->d_name);
+        if (strncmp(entry->d_name, "tasks_", 6) != 0 || len < 4 || strcmp(entry->d_name + len - 4, ".log") != 0) {
+            continue;
+        }
+
+        char *name = malloc(strlen(ARCHIVE_DIR) + len + 2);
+        if (name == NULL) {
+            break;
+        }
+        sprintf(name, "%s/%s", ARCHIVE_DIR, entry->d_name);
+        names[count++] = name;
+    }
+    closedir(dir);
+
+    // Archive names contain a timestamp, so sorting by name sorts by age
+    qsort(names, count, sizeof(char *), compare_names);
+    return count;
+}
+
+
+// Map the archived logs (if asked) & the current log, returns number of segments or -1
+static int map_history(Segment *segments, bool include_archive) {
+    int count = 0;
+
+    if (include_archive) {
+        char *names[MAX_SEGMENTS - 1];
+        int archives = list_archives(names, MAX_SEGMENTS - 1);
+        for (int i = 0; i < archives; i++) {
+            if (map_segment(names[i], &segments[count]) == 0) {
+                count++;
+            }
+            free(names[i]);
+        }
+    }
+
+    if (map_segment(LOG_FILE, &segments[count]) != 0) {
+        if (count == 0) {
+            return -1;
+        }
+    } else {
+        count++;
+    }
+    return count;
+}
+
+
+int history_print(int task_id, bool include_archive) {
+    Segment segments[MAX_SEGMENTS];
+    int count = map_history(segments, include_archive);
+
+    // If the log doesn't exist or can't be opened
+    if (count < 0) {
+        printf("No history found. Failed to open log file.\n");
+        perror("System error");
+        return 1;
+    }
+
+    // Print header
+    if (task_id == 0) {
+        printf("\n=== Task Run History ===\n\n");
+    } else {
+        printf("\n=== Task Run History: ID = %d ===\n\n", task_id);
+    }
+
+    bool empty = true;
+    for (int s = 0; s < count; s++) {
+        const char *data = segments[s].data;
+        size_t size = segments[s].size;
+        if (data == NULL) {
+            continue;
+        }
+
+        // Everything is printed, so skip line splitting altogether
+        if (task_id == 0) {
+            fwrite(data, 1, size, stdout);
+            if (data[size - 1] != '\n') {
+                putchar('\n');
+            }
+            empty = false;
+            continue;
+        }
+
+        // Find each line with memchr (vectorized in libc) & print the matching ones whole
+        const char *line = data;
+        const char *end = data + size;
+        while (line < end) {
+            const char *newline = memchr(line, '\n', (size_t)(end - line));
+            size_t len = newline ? (size_t)(newline - line) : (size_t)(end - line);
+
+            LogRecord record;
+            if (parse_log_line(line, len, &record) == 0 && record.task_id == task_id) {
+                fwrite(line, 1, len, stdout);
+                putchar('\n');
+                empty = false;
+            }
+
+            line += len + 1;
+        }
+    }
+
+    if (empty) {
+        printf("No task runs recorded yet.\n");
+    }
+
+    for (int s = 0; s < count; s++) {
+        unmap_segment(&segments[s]);
+    }
+    return 0;
+}
+
+
+// Histogram bucket for a duration
+static int duration_bucket(uint32_t ms) {
+    if (ms < EXACT_BUCKETS) {
+        return (int)ms;
+    }
+    int exponent = 31 - __builtin_clz(ms);
+    int sub = (int)((ms >> (exponent - 6)) & (SUB_BUCKETS - 1));
+    return EXACT_BUCKETS + (exponent - 7) * SUB_BUCKETS + sub;
+}
+
+
+// Middle of the durations that fall in a bucket, so the error is at most half a bucket either way
+static uint32_t bucket_value(int bucket) {
+    if (bucket < EXACT_BUCKETS) {
+        return (uint32_t)bucket;
+    }
+    int exponent = (bucket - EXACT_BUCKETS) / SUB_BUCKETS + 7;
+    uint64_t sub = (uint64_t)((bucket - EXACT_BUCKETS) % SUB_BUCKETS);
+    uint64_t width = (uint64_t)1 << (exponent - 6);
+    return (uint32_t)((SUB_BUCKETS + sub) * width + (width - 1) / 2);
+}
+
+
+// Nearest rank percentile from a duration histogram, clamped to the durations actually seen
+static uint32_t percentile(const TaskStats *task, int percent) {
+    long rank = (task->duration_count * percent + 99) / 100;
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    long seen = 0;
+    for (int bucket = 0; bucket < DURATION_BUCKETS; bucket++) {
+        seen += task->durations[bucket];
+        if (seen >= rank) {
+            uint32_t value = bucket_value(bucket);
+            if (value < task->min_duration) {
+                return task->min_duration;
+            }
+            return value < task->max_duration ? value : task->max_duration;
+        }
+    }
+    return task->max_duration;
+}
+
+
+// Slot of a task id in a table: the id's own slot or the empty one where it belongs
+static TaskStats *find_slot(TaskStats *slots, int size, int task_id) {
+    uint32_t slot = ((uint32_t)task_id * 2654435761u) & (uint32_t)(size - 1);
+    // Linear probing until the id or an empty slot is found
+    while (slots[slot].runs != 0 && slots[slot].task_id != task_id) {
+        slot = (slot + 1) & (uint32_t)(size - 1);
+    }
+    return &slots[slot];
+}
+
+
+// Get the stats slot for a task id, growing the table when it gets half full
+static TaskStats *stats_for(StatsTable *table, int task_id) {
+    if (table->used >= table->size / 2) {
+        int size = table->size ? table->size * 2 : 64;
+        TaskStats *slots = calloc((size_t)size, sizeof(TaskStats));
+        if (slots == NULL) {
+            return NULL;
+        }
+        for (int i = 0; i < table->size; i++) {
+            if (table->slots[i].runs != 0) {
+                *find_slot(slots, size, table->slots[i].task_id) = table->slots[i];
+            }
+        }
+        free(table->slots);
+        table->slots = slots;
+        table->size = size;
+    }
+
+    TaskStats *task = find_slot(table->slots, table->size, task_id);
+    if (task->runs == 0) {
+        task->task_id = task_id;
+        table->used++;
+    }
+    return task;
+}
+
+
+static int compare_stats(const void *a, const void *b) {
+    int id_a = (*(TaskStats *const *)a)->task_id;
+    int id_b = (*(TaskStats *const *)b)->task_id;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+
+int history_report(int task_id, bool include_archive) {
+    Segment segments[MAX_SEGMENTS];
+    int count = map_history(segments, include_archive);
+    if (count < 0) {
+        printf("No history found. Failed to open log file.\n");
+        perror("System error");
+        return 1;
+    }
+
+    StatsTable stats = {0};
+    long by_hour_of_day[24] = {0};
+    long total_runs = 0;
+    long first_hour = 0;
+    long last_hour = 0;
+    // Busiest single hour
+    long recent_hour[RECENT_HOURS];
+    long recent_runs[RECENT_HOURS] = {0};
+    for (int h = 0; h < RECENT_HOURS; h++) {
+        recent_hour[h] = -1;
+    }
+    long peak_hour = 0;
+    long peak_hour_runs = 0;
+
+    for (int s = 0; s < count; s++) {
+        const char *line = segments[s].data;
+        const char *end = line + segments[s].size;
+
+        while (line != NULL && line < end) {
+            const char *newline = memchr(line, '\n', (size_t)(end - line));
+            size_t len = newline ? (size_t)(newline - line) : (size_t)(end - line);
+
+            LogRecord record;
+            if (parse_log_line(line, len, &record) == 0 && (task_id == 0 || record.task_id == task_id)) {
+                TaskStats *task = stats_for(&stats, record.task_id);
+                if (task == NULL) {
+                    break;
+                }
+
+                task->runs++;
+                if (task->command[0] == '\0') {
+                    size_t copy = record.command_len < sizeof(task->command) - 1 ? record.command_len : sizeof(task->command) - 1;
+                    memcpy(task->command, record.command, copy);
+                    task->command[copy] = '\0';
+                }
+                if (record.status != STATUS_NONE) {
+                    task->with_status++;
+                    if (record.status != 0) {
+                        task->failures++;
+                    }
+                }
+                if (record.duration_ms >= 0) {
+                    if (task->durations == NULL) {
+                        task->durations = calloc(DURATION_BUCKETS, sizeof(uint32_t));
+                    }
+                    if (task->durations != NULL) {
+                        uint32_t ms = record.duration_ms > UINT32_MAX ? UINT32_MAX : (uint32_t)record.duration_ms;
+                        task->durations[duration_bucket(ms)]++;
+                        if (task->duration_count == 0 || ms < task->min_duration) {
+                            task->min_duration = ms;
+                        }
+                        task->duration_count++;
+                        if (ms > task->max_duration) {
+                            task->max_duration = ms;
+                        }
+                    }
+                }
+
+                if (total_runs == 0 || record.hour < first_hour) {
+                    first_hour = record.hour;
+                }
+                if (total_runs == 0 || record.hour > last_hour) {
+                    last_hour = record.hour;
+                }
+                total_runs++;
+                by_hour_of_day[record.hour % 24]++;
+
+                int slot = (int)(record.hour % RECENT_HOURS);
+                if (record.hour > recent_hour[slot]) {
+                    recent_hour[slot] = record.hour;
+                    recent_runs[slot] = 0;
+                }
+                if (record.hour == recent_hour[slot] && ++recent_runs[slot] > peak_hour_runs) {
+                    peak_hour_runs = recent_runs[slot];
+                    peak_hour = record.hour;
+                }
+            }
+
+            line += len + 1;
+        }
+    }
+
+    for (int s = 0; s < count; s++) {
+        unmap_segment(&segments[s]);
+    }
+
+    if (total_runs == 0) {
+        printf("No task runs recorded yet.\n");
+        free(stats.slots);
+        return 0;
+    }
+
+    long hours = last_hour - first_hour + 1;
+    time_t peak_time = (time_t)peak_hour * 3600;
+    char peak_label[32];
+    strftime(peak_label, sizeof(peak_label), "%Y-%m-%d %H:00", gmtime(&peak_time));
+
+    printf("\n=== Task Run Report (%d log file%s) ===\n\n", count, count == 1 ? "" : "s");
+    printf("Runs:      %ld over %ld hour%s\n", total_runs, hours, hours == 1 ? "" : "s");
+    printf("Per hour:  %.1f on average, peak %ld at %s\n\n", (double)total_runs / hours, peak_hour_runs, peak_label);
+
+    printf("%-6s %8s %7s %8s %8s %8s %8s  %s\n", "ID", "RUNS", "FAIL%", "P50ms", "P90ms", "P99ms", "MAXms", "COMMAND");
+    // Rows in id order
+    TaskStats **rows = malloc((size_t)stats.used * sizeof(TaskStats *));
+    int row_count = 0;
+    for (int i = 0; rows != NULL && i < stats.size; i++) {
+        if (stats.slots[i].runs != 0) {
+            rows[row_count++] = &stats.slots[i];
+        }
+    }
+    if (rows != NULL) {
+        qsort(rows, (size_t)row_count, sizeof(TaskStats *), compare_stats);
+    }
+
+    for (int row = 0; row < row_count; row++) {
+        TaskStats *task = rows[row];
+        int id = task->task_id;
+
+        char fail_rate[16] = "-";
+        if (task->with_status > 0) {
+            snprintf(fail_rate, sizeof(fail_rate), "%.1f", 100.0 * task->failures / task->with_status);
+        }
+
+        if (task->duration_count > 0) {
+            printf("%-6d %8ld %7s %8u %8u %8u %8u  %s\n", id, task->runs, fail_rate,
+                   percentile(task, 50), percentile(task, 90), percentile(task, 99),
+                   task->max_duration, task->command);
+        } else {
+            printf("%-6d %8ld %7s %8s %8s %8s %8s  %s\n", id, task->runs, fail_rate, "-", "-", "-", "-", task->command);
+        }
+    }
+    for (int i = 0; i < stats.size; i++) {
+        free(stats.slots[i].durations);
+    }
+    free(rows);
+    free(stats.slots);
+
+    // Bar chart of runs by hour of day
+    long busiest = 0;
+    for (int h = 0; h < 24; h++) {
+        if (by_hour_of_day[h] > busiest) {
+            busiest = by_hour_of_day[h];
+        }
+    }
+    printf("\nRuns by hour of day:\n");
+    for (int h = 0; h < 24; h++) {
+        int width = (int)(by_hour_of_day[h] * 40 / busiest);
+        printf("  %02d:00 %-40.*s %ld\n", h, width, "########################################", by_hour_of_day[h]);
+    }
+    printf("\n");
+
+    return 0;
+}
+
+
+// Print complete lines in buf that match the task filter, returns bytes consumed
+static size_t print_new_lines(const char *buf, size_t len, int task_id) {
+    size_t consumed = 0;
+    while (consumed < len) {
+        const char *line = buf + consumed;
+        const char *newline = memchr(line, '\n', len - consumed);
+        // Keep partial lines until the rest is written
+        if (newline == NULL) {
+            break;
+        }
+        size_t line_len = (size_t)(newline - line);
+
+        LogRecord record;
+        if (task_id == 0 || (parse_log_line(line, line_len, &record) == 0 && record.task_id == task_id)) {
+            fwrite(line, 1, line_len + 1, stdout);
+        }
+        consumed += line_len + 1;
+    }
+    fflush(stdout);
+    return consumed;
+}
+
+
+int history_follow(int task_id) {
+    int fd = open(LOG_FILE, O_RDONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        printf("No history found. Failed to open log file.\n");
+        perror("System error");
+        return 1;
+    }
+    // Only show runs from now on
+    lseek(fd, 0, SEEK_END);
+
+#ifdef __linux__
+    int notify = inotify_init1(IN_CLOEXEC);
+    int watch = notify >= 0 ? inotify_add_watch(notify, LOG_FILE, IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF) : -1;
+#endif
+
+    if (task_id == 0) {
+        printf("Following %s (Ctrl-C to stop)...\n", LOG_FILE);
+    } else {
+        printf("Following runs of task %d (Ctrl-C to stop)...\n", task_id);
+    }
+    fflush(stdout);
+
+    char buf[65536];
+    size_t used = 0;
+    // Read straight away after switching to a new log file
+    bool skip_wait = false;
+
+    while (true) {
+        bool rotated = false;
+
+#ifdef __linux__
+        if (skip_wait) {
+            skip_wait = false;
+        } else if (watch >= 0) {
+            // Block until the log changes instead of polling
+            char events[4096];
+            ssize_t got = read(notify, events, sizeof(events));
+            for (ssize_t off = 0; off < got; ) {
+                const struct inotify_event *event = (const struct inotify_event *)(events + off);
+                if (event->wd == watch && (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED))) {
+                    rotated = true;
+                }
+                off += sizeof(struct inotify_event) + event->len;
+            }
+        } else {
+            sleep(1);
+        }
+#else
+        if (skip_wait) {
+            skip_wait = false;
+        } else {
+            sleep(1);
+        }
+#endif
+
+        // Read everything appended since last time
+        ssize_t got;
+        while ((got = read(fd, buf + used, sizeof(buf) - used)) > 0) {
+            used += (size_t)got;
+            size_t consumed = print_new_lines(buf, used, task_id);
+            // A single line longer than the buffer gets printed as is
+            if (consumed == 0 && used == sizeof(buf)) {
+                fwrite(buf, 1, used, stdout);
+                consumed = used;
+            }
+            memmove(buf, buf + consumed, used - consumed);
+            used -= consumed;
+        }
+
+#ifndef __linux__
+        // Without inotify, notice archiving by the file shrinking or being replaced
+        struct stat by_name;
+        struct stat by_fd;
+        if (stat(LOG_FILE, &by_name) != 0 || fstat(fd, &by_fd) != 0 || by_name.st_ino != by_fd.st_ino) {
+            rotated = true;
+        }
+#endif
+
+        // Log was archived, switch to the new log file
+        if (rotated) {
+            close(fd);
+            for (int tries = 0; (fd = open(LOG_FILE, O_RDONLY)) < 0 && tries < 50; tries++) {
+                usleep(100000);
+            }
+            if (fd < 0) {
+                perror("Failed to reopen log file");
+                return 1;
+            }
+            used = 0;
+            skip_wait = true;
+#ifdef __linux__
+            if (notify >= 0) {
+                inotify_rm_watch(notify, watch);
+                watch = inotify_add_watch(notify, LOG_FILE, IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+            }
+#endif
+        }
+    }
+
+    return 0;
+}
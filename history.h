@@ -0,0 +1,33 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// One "Ran task" line of the log file
+typedef struct {
+    // Hours since 1970-01-01 00:00 (local time as written in the log)
+    long hour;
+    int task_id;
+    // Exit code, STATUS_NONE for lines written before exit codes were logged
+    int status;
+    // Run time in milliseconds, -1 for lines written before durations were logged
+    long duration_ms;
+    // Command text (points into the line, not NUL terminated)
+    const char *command;
+    size_t command_len;
+} LogRecord;
+
+// Parse a log line (without its newline), returns 0 if it's a task run & -1 otherwise
+int parse_log_line(const char *line, size_t len, LogRecord *record);
+
+// Print runs from the log (task_id 0 for all), optionally including archived logs
+int history_print(int task_id, bool include_archive);
+
+// Print per task aggregates (runs, failure rate, duration percentiles, runs per hour)
+int history_report(int task_id, bool include_archive);
+
+// Print new runs as they're logged until interrupted
+int history_follow(int task_id);
+
+#endif
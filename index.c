@@ -0,0 +1,460 @@
+#include "index.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// One slot of a label hash table (label -> positions of tasks with that label)
+typedef struct {
+    char *key;
+    int *items;
+    int count;
+    int capacity;
+} Bucket;
+
+// Open addressing hash table, size is always a power of 2
+typedef struct {
+    Bucket *buckets;
+    int size;
+} LabelIndex;
+
+static LabelIndex tag_index;
+static LabelIndex group_index;
+
+// Task positions split by active state
+static int *active_list;
+static int active_count;
+static int *paused_list;
+static int paused_count;
+
+// All task positions sorted by last exit status
+static int *by_status;
+// Active task positions sorted by next due time
+static int *by_due;
+static int due_count;
+
+static const Task *indexed_tasks;
+static int indexed_count;
+
+// State used by the qsort comparators
+static SortKey compare_key;
+static bool compare_descending;
+
+
+time_t next_due(const Task *task) {
+    // A skipped run counts like a run for when the task is due next
+    time_t since = task->skipped_at > task->last_run ? task->skipped_at : task->last_run;
+    if (since == 0) {
+        return 0;
+    }
+    return since + task->interval_seconds;
+}
+
+
+// FNV-1a hash of the first len bytes of a string
+static uint32_t hash_label(const char *label, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)label[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+// Find the bucket for a label, creating it if asked to. Returns NULL if not found.
+static Bucket *find_bucket(LabelIndex *index, const char *label, size_t len, bool create) {
+    if (index->size == 0) {
+        return NULL;
+    }
+
+    uint32_t slot = hash_label(label, len) & (uint32_t)(index->size - 1);
+
+    // Linear probing until the label or an empty slot is found
+    while (index->buckets[slot].key != NULL) {
+        Bucket *bucket = &index->buckets[slot];
+        if (strlen(bucket->key) == len && memcmp(bucket->key, label, len) == 0) {
+            return bucket;
+        }
+        slot = (slot + 1) & (uint32_t)(index->size - 1);
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    Bucket *bucket = &index->buckets[slot];
+    bucket->key = malloc(len + 1);
+    if (bucket->key == NULL) {
+        return NULL;
+    }
+    memcpy(bucket->key, label, len);
+    bucket->key[len] = '\0';
+    return bucket;
+}
+
+
+// Append a task position to a bucket
+static void bucket_push(Bucket *bucket, int position) {
+    if (bucket->count == bucket->capacity) {
+        int capacity = bucket->capacity ? bucket->capacity * 2 : 4;
+        int *items = realloc(bucket->items, capacity * sizeof(int));
+        if (items == NULL) {
+            return;
+        }
+        bucket->items = items;
+        bucket->capacity = capacity;
+    }
+    bucket->items[bucket->count++] = position;
+}
+
+
+// Allocate a table big enough to keep the load factor under 1/2
+static void label_index_init(LabelIndex *index, int max_labels) {
+    int size = 16;
+    while (size < max_labels * 2) {
+        size *= 2;
+    }
+    index->buckets = calloc(size, sizeof(Bucket));
+    index->size = index->buckets ? size : 0;
+}
+
+
+static void label_index_free(LabelIndex *index) {
+    for (int i = 0; i < index->size; i++) {
+        free(index->buckets[i].key);
+        free(index->buckets[i].items);
+    }
+    free(index->buckets);
+    index->buckets = NULL;
+    index->size = 0;
+}
+
+
+// Add every label in a comma separated list to a table
+static void label_index_add(LabelIndex *index, const char *labels, int position) {
+    const char *start = labels;
+    while (*start != '\0') {
+        const char *end = strchr(start, ',');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+
+        if (len > 0) {
+            Bucket *bucket = find_bucket(index, start, len, true);
+            // Skip duplicate labels on the same task
+            if (bucket && (bucket->count == 0 || bucket->items[bucket->count - 1] != position)) {
+                bucket_push(bucket, position);
+            }
+        }
+
+        if (end == NULL) {
+            break;
+        }
+        start = end + 1;
+    }
+}
+
+
+bool has_label(const char *labels, const char *label) {
+    size_t len = strlen(label);
+    const char *start = labels;
+    while (*start != '\0') {
+        const char *end = strchr(start, ',');
+        size_t part = end ? (size_t)(end - start) : strlen(start);
+
+        if (part == len && memcmp(start, label, len) == 0) {
+            return true;
+        }
+
+        if (end == NULL) {
+            break;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+
+// Compare two task positions by the field in compare_key
+static int compare_positions(const void *a, const void *b) {
+    const Task *x = &indexed_tasks[*(const int *)a];
+    const Task *y = &indexed_tasks[*(const int *)b];
+    long long left = 0;
+    long long right = 0;
+
+    switch (compare_key) {
+        case SORT_NEXT_DUE:
+            left = next_due(x);
+            right = next_due(y);
+            break;
+        case SORT_LAST_RUN:
+            left = x->last_run;
+            right = y->last_run;
+            break;
+        case SORT_STATUS:
+            left = x->last_status;
+            right = y->last_status;
+            break;
+        case SORT_INTERVAL:
+            left = x->interval_seconds;
+            right = y->interval_seconds;
+            break;
+        case SORT_ID:
+            break;
+    }
+
+    int result = (left > right) - (left < right);
+    // Fall back to ID so output order is stable
+    if (result == 0) {
+        result = (x->id > y->id) - (x->id < y->id);
+    }
+    return compare_descending ? -result : result;
+}
+
+
+static void sort_positions(int *positions, int count, SortKey key, bool descending) {
+    compare_key = key;
+    compare_descending = descending;
+    qsort(positions, count, sizeof(int), compare_positions);
+}
+
+
+void index_free() {
+    label_index_free(&tag_index);
+    label_index_free(&group_index);
+    free(active_list);
+    free(paused_list);
+    free(by_status);
+    free(by_due);
+    active_list = paused_list = by_status = by_due = NULL;
+    active_count = paused_count = due_count = 0;
+    indexed_tasks = NULL;
+    indexed_count = 0;
+}
+
+
+void index_build(const Task *tasks, int count) {
+    index_free();
+
+    indexed_tasks = tasks;
+    indexed_count = count;
+
+    // Count label occurrences so the hash tables never need to grow
+    int tag_total = 0;
+    for (int i = 0; i < count; i++) {
+        tag_total++;
+        for (const char *c = tasks[i].tags; *c != '\0'; c++) {
+            if (*c == ',') {
+                tag_total++;
+            }
+        }
+    }
+    label_index_init(&tag_index, tag_total);
+    label_index_init(&group_index, count);
+
+    int slots = count > 0 ? count : 1;
+    active_list = malloc(slots * sizeof(int));
+    paused_list = malloc(slots * sizeof(int));
+    by_status = malloc(slots * sizeof(int));
+    by_due = malloc(slots * sizeof(int));
+    if (!active_list || !paused_list || !by_status || !by_due) {
+        index_free();
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        label_index_add(&tag_index, tasks[i].tags, i);
+        if (tasks[i].group[0] != '\0') {
+            label_index_add(&group_index, tasks[i].group, i);
+        }
+
+        if (tasks[i].active) {
+            active_list[active_count++] = i;
+            by_due[due_count++] = i;
+        } else {
+            paused_list[paused_count++] = i;
+        }
+        by_status[i] = i;
+    }
+
+    sort_positions(by_status, count, SORT_STATUS, false);
+    sort_positions(by_due, due_count, SORT_NEXT_DUE, false);
+}
+
+
+int index_lookup_tag(const char *tag, const int **positions) {
+    Bucket *bucket = find_bucket(&tag_index, tag, strlen(tag), false);
+    if (bucket == NULL) {
+        *positions = NULL;
+        return 0;
+    }
+    *positions = bucket->items;
+    return bucket->count;
+}
+
+
+// First position in by_status whose status is >= value
+static int status_lower_bound(int value) {
+    int low = 0;
+    int high = indexed_count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (indexed_tasks[by_status[mid]].last_status < value) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+
+// Number of tasks in by_due that are due at or before a time
+static int due_upper_bound(time_t limit) {
+    int low = 0;
+    int high = due_count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (next_due(&indexed_tasks[by_due[mid]]) <= limit) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+
+// Check every filter of a query against a single task
+static bool task_matches(const Task *task, const TaskQuery *query, time_t now) {
+    if (query->tag && !has_label(task->tags, query->tag)) {
+        return false;
+    }
+    if (query->group && strcmp(task->group, query->group) != 0) {
+        return false;
+    }
+    if (query->state == STATE_ACTIVE && !task->active) {
+        return false;
+    }
+    if (query->state == STATE_PAUSED && task->active) {
+        return false;
+    }
+
+    switch (query->status) {
+        case STATUS_OK:
+            if (task->last_status != 0) return false;
+            break;
+        case STATUS_FAILED:
+            if (task->last_status <= 0) return false;
+            break;
+        case STATUS_NEVER:
+            if (task->last_status != STATUS_NONE) return false;
+            break;
+        case STATUS_EXACT:
+            if (task->last_status != query->status_code) return false;
+            break;
+        case STATUS_ANY:
+            break;
+    }
+
+    if (query->due_within >= 0 &&
+        (!task->active || task->interval_seconds <= 0 || next_due(task) > now + query->due_within)) {
+        return false;
+    }
+    if (query->grep && strstr(task->command, query->grep) == NULL) {
+        return false;
+    }
+    return true;
+}
+
+
+int index_query(const TaskQuery *query, time_t now, int *out) {
+    // Start from the smallest candidate list any index can give us. Without one every task is
+    // a candidate, an index that matched nothing leaves none.
+    const int *candidates = NULL;
+    int candidate_count = indexed_count;
+    bool indexed = false;
+
+    const int *list;
+    int count;
+
+    if (query->tag) {
+        count = index_lookup_tag(query->tag, &list);
+        if (count < candidate_count || !indexed) {
+            candidates = list;
+            candidate_count = count;
+            indexed = true;
+        }
+    }
+
+    if (query->group) {
+        Bucket *bucket = find_bucket(&group_index, query->group, strlen(query->group), false);
+        count = bucket ? bucket->count : 0;
+        if (count < candidate_count || !indexed) {
+            candidates = bucket ? bucket->items : NULL;
+            candidate_count = count;
+            indexed = true;
+        }
+    }
+
+    if (query->state != STATE_ANY) {
+        list = query->state == STATE_ACTIVE ? active_list : paused_list;
+        count = query->state == STATE_ACTIVE ? active_count : paused_count;
+        if (count < candidate_count || !indexed) {
+            candidates = list;
+            candidate_count = count;
+            indexed = true;
+        }
+    }
+
+    if (query->status != STATUS_ANY) {
+        int low = 0;
+        int high = 0;
+        switch (query->status) {
+            case STATUS_OK:
+                low = status_lower_bound(0);
+                high = status_lower_bound(1);
+                break;
+            case STATUS_FAILED:
+                low = status_lower_bound(1);
+                high = indexed_count;
+                break;
+            case STATUS_NEVER:
+                low = status_lower_bound(STATUS_NONE);
+                high = status_lower_bound(STATUS_NONE + 1);
+                break;
+            case STATUS_EXACT:
+                low = status_lower_bound(query->status_code);
+                high = query->status_code == INT_MAX ? indexed_count : status_lower_bound(query->status_code + 1);
+                break;
+            case STATUS_ANY:
+                break;
+        }
+        if (high - low < candidate_count || !indexed) {
+            candidates = by_status + low;
+            candidate_count = high - low;
+            indexed = true;
+        }
+    }
+
+    if (query->due_within >= 0) {
+        count = due_upper_bound(now + query->due_within);
+        if (count < candidate_count || !indexed) {
+            candidates = by_due;
+            candidate_count = count;
+            indexed = true;
+        }
+    }
+
+    // Check the remaining filters on each candidate
+    int matched = 0;
+    for (int i = 0; i < candidate_count; i++) {
+        int position = indexed ? candidates[i] : i;
+        if (task_matches(&indexed_tasks[position], query, now)) {
+            out[matched++] = position;
+        }
+    }
+
+    sort_positions(out, matched, query->sort, query->descending);
+    return matched;
+}
@@ -0,0 +1,27 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "task.h"
+
+// Secondary in-memory indexes over the task array. They are rebuilt from
+// scratch whenever the task array changes and are only valid until then.
+
+// Build all indexes for the given task array
+void index_build(const Task *tasks, int count);
+
+// Free all memory held by the indexes
+void index_free();
+
+// Get the positions of tasks carrying a tag, returns how many there are
+int index_lookup_tag(const char *tag, const int **positions);
+
+// Run a query, fill out with matching task positions in sorted order & return how many matched
+int index_query(const TaskQuery *query, time_t now, int *out);
+
+// Time a task is next due to run (0 if it has never run)
+time_t next_due(const Task *task);
+
+// Check if a comma separated label list contains a label
+bool has_label(const char *labels, const char *label);
+
+#endif
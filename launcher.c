@@ -0,0 +1,415 @@
+#include "launcher.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+// What the scheduler sends for each run
+typedef struct {
+    int run_id;
+    char command[MAX_COMMAND_LEN];
+    char cwd[MAX_PATH_LEN];
+    char env[MAX_ENV_LEN];
+    int umask;
+} LaunchRequest;
+
+// What the launcher sends back once a command finished
+typedef struct {
+    int run_id;
+    int status;
+} LaunchReply;
+
+// A command the launcher started & hasn't reaped yet
+typedef struct {
+    pid_t pid;
+    int run_id;
+} Child;
+
+// Scheduler's end of the socket & the launcher's pid (-1 when not running)
+static int launcher_fd = -1;
+static pid_t launcher_pid = -1;
+
+// Scheduler side: runs sent to the launcher that haven't been reported yet, and results that
+// are ready to be collected (runs done without the launcher, or lost when it died). Every run
+// not collected yet is in one of the two, so they share a capacity.
+static int *submitted = NULL;
+static int submitted_count = 0;
+static LaunchReply *finished = NULL;
+static int finished_count = 0;
+static int run_capacity = 0;
+static int next_run_id = 1;
+
+// Launcher side: written to from the SIGCHLD handler so poll() wakes up to reap children
+static int child_pipe[2] = { -1, -1 };
+
+
+// Write all bytes, returns 0 on success
+static int write_all(int fd, const void *data, size_t len) {
+    const char *pos = data;
+    while (len > 0) {
+        ssize_t written = write(fd, pos, len);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return -1;
+        }
+        pos += written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
+
+
+// Read exactly len bytes, returns 0 on success & -1 on error or end of file
+static int read_all(int fd, void *data, size_t len) {
+    char *pos = data;
+    while (len > 0) {
+        ssize_t got = read(fd, pos, len);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        pos += got;
+        len -= (size_t)got;
+    }
+    return 0;
+}
+
+
+// Set up the environment of a forked child & run the command (never returns)
+static void exec_request(const LaunchRequest *request) {
+    // Undo signal settings of the scheduler & launcher
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+
+    if (request->cwd[0] != '\0' && chdir(request->cwd) != 0) {
+        perror("Failed to change to task directory");
+        _exit(126);
+    }
+
+    if (request->umask != UMASK_INHERIT) {
+        umask((mode_t)request->umask);
+    }
+
+    // Apply NAME=value overrides separated by ';'
+    char env[MAX_ENV_LEN];
+    strncpy(env, request->env, sizeof(env) - 1);
+    env[sizeof(env) - 1] = '\0';
+    for (char *entry = strtok(env, ";"); entry != NULL; entry = strtok(NULL, ";")) {
+        char *equals = strchr(entry, '=');
+        if (equals != NULL) {
+            *equals = '\0';
+            setenv(entry, equals + 1, 1);
+        }
+    }
+
+    execl("/bin/sh", "sh", "-c", request->command, (char *)NULL);
+    _exit(127);
+}
+
+
+// Fork & start a request, returns the child's pid (-1 if fork failed)
+static pid_t spawn(const LaunchRequest *request, int close_fd) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (close_fd >= 0) {
+            close(close_fd);
+        }
+        exec_request(request);
+    }
+    return pid;
+}
+
+
+// Fork, run a request & wait for it, returns a wait status (-1 if fork failed)
+static int spawn_and_wait(const LaunchRequest *request, int close_fd) {
+    pid_t pid = spawn(request, close_fd);
+    if (pid < 0) {
+        return -1;
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return status;
+}
+
+
+static void on_child_exit(int sig) {
+    (void)sig;
+    int saved = errno;
+    if (write(child_pipe[1], "x", 1) < 0) {
+        // Pipe is full, so a wakeup is pending already
+    }
+    errno = saved;
+}
+
+
+// Reap exited children & report them, returns -1 if the scheduler can't be told anymore
+static int reap_children(int fd, Child *children, int *child_count) {
+    char drain[64];
+    while (read(child_pipe[0], drain, sizeof(drain)) > 0) {
+    }
+
+    pid_t pid;
+    int status;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (int i = 0; i < *child_count; i++) {
+            if (children[i].pid != pid) {
+                continue;
+            }
+            LaunchReply reply = { children[i].run_id, status };
+            children[i] = children[--(*child_count)];
+            if (write_all(fd, &reply, sizeof(reply)) != 0) {
+                return -1;
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+
+int launcher_main(int fd) {
+    // Same as system(): the command gets the signals, not the launcher
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+
+    // Commands run side by side, each one is reported when it exits
+    if (pipe(child_pipe) != 0) {
+        perror("Failed to create launcher pipe");
+        return 1;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(child_pipe[i], F_SETFD, FD_CLOEXEC);
+        fcntl(child_pipe[i], F_SETFL, O_NONBLOCK);
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_child_exit;
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, NULL);
+
+    Child *children = NULL;
+    int child_count = 0;
+    int child_capacity = 0;
+
+    LaunchRequest request;
+    while (true) {
+        struct pollfd fds[2] = { { fd, POLLIN, 0 }, { child_pipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if ((fds[1].revents & POLLIN) && reap_children(fd, children, &child_count) != 0) {
+            break;
+        }
+        if (!(fds[0].revents & (POLLIN | POLLHUP))) {
+            continue;
+        }
+
+        // Stop once the scheduler closes its end, commands still running finish on their own
+        if (read_all(fd, &request, sizeof(request)) != 0) {
+            break;
+        }
+        request.command[MAX_COMMAND_LEN - 1] = '\0';
+        request.cwd[MAX_PATH_LEN - 1] = '\0';
+        request.env[MAX_ENV_LEN - 1] = '\0';
+
+        if (child_count == child_capacity) {
+            int capacity = child_capacity ? child_capacity * 2 : 16;
+            Child *grown = realloc(children, (size_t)capacity * sizeof(Child));
+            if (grown == NULL) {
+                break;
+            }
+            children = grown;
+            child_capacity = capacity;
+        }
+
+        pid_t pid = spawn(&request, fd);
+        if (pid < 0) {
+            LaunchReply reply = { request.run_id, -1 };
+            if (write_all(fd, &reply, sizeof(reply)) != 0) {
+                break;
+            }
+            continue;
+        }
+        children[child_count].pid = pid;
+        children[child_count].run_id = request.run_id;
+        child_count++;
+    }
+
+    free(children);
+    close(fd);
+    return 0;
+}
+
+
+int launcher_start() {
+    // A dead launcher must not kill the scheduler with SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return -1;
+    }
+    // Keep the scheduler's end out of task processes
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+
+        // Re-execute flux so the launcher starts from a fresh, small address space
+        char fd_arg[16];
+        snprintf(fd_arg, sizeof(fd_arg), "%d", fds[1]);
+        execl("/proc/self/exe", "flux", LAUNCHER_COMMAND, fd_arg, (char *)NULL);
+
+        // No /proc (ex. macOS), keep going as a plain fork
+        _exit(launcher_main(fds[1]));
+    }
+
+    close(fds[1]);
+    launcher_fd = fds[0];
+    launcher_pid = pid;
+    return 0;
+}
+
+
+void launcher_stop() {
+    if (launcher_fd >= 0) {
+        close(launcher_fd);
+        launcher_fd = -1;
+    }
+    if (launcher_pid > 0) {
+        waitpid(launcher_pid, NULL, 0);
+        launcher_pid = -1;
+    }
+}
+
+
+// Report a run as done without the launcher (ran directly, or lost when the launcher died)
+static void add_finished(int run_id, int status) {
+    finished[finished_count].run_id = run_id;
+    finished[finished_count].status = status;
+    finished_count++;
+}
+
+
+// Forget about a run the launcher was asked for
+static void remove_submitted(int run_id) {
+    for (int i = 0; i < submitted_count; i++) {
+        if (submitted[i] == run_id) {
+            submitted[i] = submitted[--submitted_count];
+            return;
+        }
+    }
+}
+
+
+// The launcher went away: runs it had are lost, report them as failed & start a new one
+static void restart_launcher() {
+    launcher_stop();
+    for (int i = 0; i < submitted_count; i++) {
+        add_finished(submitted[i], -1);
+    }
+    submitted_count = 0;
+    launcher_start();
+}
+
+
+int launcher_submit(const Task *task) {
+    LaunchRequest request;
+    memset(&request, 0, sizeof(request));
+    request.run_id = next_run_id++;
+    strncpy(request.command, task->command, MAX_COMMAND_LEN - 1);
+    strncpy(request.cwd, task->cwd, MAX_PATH_LEN - 1);
+    strncpy(request.env, task->env, MAX_ENV_LEN - 1);
+    request.umask = task->umask;
+
+    if (submitted_count + finished_count == run_capacity) {
+        int capacity = run_capacity ? run_capacity * 2 : 16;
+        int *grown = realloc(submitted, (size_t)capacity * sizeof(int));
+        if (grown == NULL) {
+            return -1;
+        }
+        submitted = grown;
+        LaunchReply *grown_finished = realloc(finished, (size_t)capacity * sizeof(LaunchReply));
+        if (grown_finished == NULL) {
+            return -1;
+        }
+        finished = grown_finished;
+        run_capacity = capacity;
+    }
+
+    // Launcher died, start a new one. A request that wasn't sent can't have started, so resend it.
+    if (launcher_fd < 0 || write_all(launcher_fd, &request, sizeof(request)) != 0) {
+        restart_launcher();
+        if (launcher_fd < 0 || write_all(launcher_fd, &request, sizeof(request)) != 0) {
+            // Last resort, run it from the scheduler itself
+            add_finished(request.run_id, spawn_and_wait(&request, -1));
+            return request.run_id;
+        }
+    }
+    submitted[submitted_count++] = request.run_id;
+    return request.run_id;
+}
+
+
+int launcher_wait_fd() {
+    return launcher_fd;
+}
+
+
+int launcher_collect(int *status, bool block) {
+    if (finished_count == 0 && launcher_fd >= 0 && submitted_count > 0) {
+        struct pollfd fd = { launcher_fd, POLLIN, 0 };
+        int ready;
+        while ((ready = poll(&fd, 1, block ? -1 : 0)) < 0 && errno == EINTR) {
+        }
+
+        if (ready > 0) {
+            LaunchReply reply;
+            if (read_all(launcher_fd, &reply, sizeof(reply)) == 0) {
+                remove_submitted(reply.run_id);
+                *status = reply.status;
+                return reply.run_id;
+            }
+            restart_launcher();
+        }
+    }
+
+    if (finished_count == 0) {
+        return 0;
+    }
+    int run_id = finished[0].run_id;
+    *status = finished[0].status;
+    memmove(finished, finished + 1, (size_t)(finished_count - 1) * sizeof(LaunchReply));
+    finished_count--;
+    return run_id;
+}
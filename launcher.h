@@ -0,0 +1,30 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include "task.h"
+
+// Hidden command the scheduler uses to start its launcher process
+#define LAUNCHER_COMMAND "__launcher"
+
+// Start the launcher: a small process forked & re-executed before the task table grows,
+// so every task spawn forks that process instead of the scheduler. Returns 0 on success.
+int launcher_start();
+
+// Start a task's command in its environment without waiting for it, returns a run id (-1 if out
+// of memory). The launcher runs commands side by side & reports each one when it exits.
+int launcher_submit(const Task *task);
+
+// Get a finished run, returns its run id & fills a wait status like system(). Returns 0 when no
+// run has finished, or with block set, when none is running.
+int launcher_collect(int *status, bool block);
+
+// Becomes readable when a run finished, for sleeping until then (-1 without a launcher)
+int launcher_wait_fd();
+
+// Stop the launcher process
+void launcher_stop();
+
+// Main loop of the launcher process, reads requests from fd until the scheduler goes away
+int launcher_main(int fd);
+
+#endif
@@ -0,0 +1,75 @@
+#include "load.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+// Default thresholds in percent of CPU pressure
+#define LOAD_BUSY_PERCENT 40.0
+#define LOAD_SATURATED_PERCENT 80.0
+#define PRESSURE_FILE "/proc/pressure/cpu"
+
+
+// Read "some avg10=X" from the pressure file, returns -1 if it isn't available
+static double read_pressure() {
+    FILE *txt = fopen(PRESSURE_FILE, "r");
+    if (!txt) {
+        return -1;
+    }
+
+    double avg10 = -1;
+    if (fscanf(txt, "some avg10=%lf", &avg10) != 1) {
+        avg10 = -1;
+    }
+    fclose(txt);
+    return avg10;
+}
+
+
+double host_load(const char **source) {
+    double pressure = read_pressure();
+    if (pressure >= 0) {
+        if (source) *source = "cpu pressure";
+        return pressure;
+    }
+
+    // No PSI (older kernels, macOS): count how far the run queue exceeds the CPUs
+    double loadavg;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (getloadavg(&loadavg, 1) != 1 || cpus <= 0) {
+        if (source) *source = "unknown";
+        return 0;
+    }
+    if (source) *source = "load average";
+
+    double excess = loadavg / (double)cpus - 1.0;
+    return excess > 0 ? excess * 100.0 : 0;
+}
+
+
+// Threshold from the environment or its default
+static double threshold(const char *name, double fallback) {
+    const char *value = getenv(name);
+    if (value == NULL || value[0] == '\0') {
+        return fallback;
+    }
+    return atof(value);
+}
+
+
+LoadLevel load_level(double load) {
+    static double busy = -1;
+    static double saturated = -1;
+    if (busy < 0) {
+        busy = threshold("FLUX_LOAD_BUSY", LOAD_BUSY_PERCENT);
+        saturated = threshold("FLUX_LOAD_SATURATED", LOAD_SATURATED_PERCENT);
+    }
+
+    if (load >= saturated) {
+        return LOAD_SATURATED;
+    }
+    if (load >= busy) {
+        return LOAD_BUSY;
+    }
+    return LOAD_NORMAL;
+}
@@ -0,0 +1,18 @@
+#ifndef LOAD_H
+#define LOAD_H
+
+// How busy the host is, decides which priority classes get to run
+typedef enum {
+    LOAD_NORMAL,
+    LOAD_BUSY,
+    LOAD_SATURATED
+} LoadLevel;
+
+// CPU pressure of the host in percent (time runnable tasks spent waiting for a CPU).
+// Uses /proc/pressure/cpu when available, else the load average per CPU.
+double host_load(const char **source);
+
+// Turn a host_load() value into a level (thresholds can be set with FLUX_LOAD_BUSY & FLUX_LOAD_SATURATED)
+LoadLevel load_level(double load);
+
+#endif
@@ -1,14 +1,151 @@
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
 #include <unistd.h>
 #include "task.h"
+#include "history.h"
+#include "trace.h"
+#include "store.h"
+#include "launcher.h"
+#include "load.h"
+#include "trigger.h"
+
+
+// Times an edit is redone when other processes keep saving first
+#define MAX_SAVE_ATTEMPTS 5
+// Conflicts allowed before holding the writer lock across load & save
+#define OPTIMISTIC_ATTEMPTS 3
+
+// Set when save_retry() gives up
+static bool save_failed = false;
+
+
+// Save an edit. Returns true if another process saved since our load_tasks(), in which case
+// the caller reloads & applies its edit again so neither change is lost.
+static bool save_retry(int *attempts) {
+    static int held_lock = -1;
+
+    int result = save_tasks();
+    if (result == SAVE_CONFLICT && ++(*attempts) < MAX_SAVE_ATTEMPTS) {
+        if (*attempts == OPTIMISTIC_ATTEMPTS) {
+            // Lost too many races, keep other writers out until this edit is saved
+            held_lock = store_lock();
+        } else if (held_lock < 0) {
+            // Back off a little so competing writers spread out
+            usleep(1000 * (*attempts) + rand() % 1000);
+        }
+        return true;
+    }
+
+    store_unlock(held_lock);
+    held_lock = -1;
+
+    save_failed = result != SAVE_OK;
+    if (result == SAVE_CONFLICT) {
+        printf("Tasks kept changing while saving. Please try again.\n");
+    }
+    return false;
+}
+
+
+// Parse the options of 'flux list' into a query, returns 0 on success
+static int parse_list_options(int argc, char *argv[], TaskQuery *query, ListFormat *format) {
+    for (int i = 2; i < argc; i++) {
+        const char *opt = argv[i];
+        // Options that don't take a value
+        if (strcmp(opt, "--active") == 0) {
+            query->state = STATE_ACTIVE;
+            continue;
+        } else if (strcmp(opt, "--paused") == 0) {
+            query->state = STATE_PAUSED;
+            continue;
+        } else if (strcmp(opt, "--desc") == 0) {
+            query->descending = true;
+            continue;
+        }
+
+        // Every other option needs a value after it
+        if (i + 1 >= argc) {
+            printf("Missing value for option '%s'.\n", opt);
+            return 1;
+        }
+        const char *value = argv[++i];
+
+        if (strcmp(opt, "--tag") == 0) {
+            query->tag = value;
+        } else if (strcmp(opt, "--group") == 0) {
+            query->group = value;
+        } else if (strcmp(opt, "--grep") == 0) {
+            query->grep = value;
+        } else if (strcmp(opt, "--status") == 0) {
+            if (strcmp(value, "ok") == 0) {
+                query->status = STATUS_OK;
+            } else if (strcmp(value, "failed") == 0) {
+                query->status = STATUS_FAILED;
+            } else if (strcmp(value, "never") == 0) {
+                query->status = STATUS_NEVER;
+            } else {
+                query->status = STATUS_EXACT;
+                query->status_code = atoi(value);
+            }
+        } else if (strcmp(opt, "--due") == 0) {
+            query->due_within = atoi(value);
+            if (query->due_within < 0) {
+                printf("Due time must not be negative.\n");
+                return 1;
+            }
+        } else if (strcmp(opt, "--sort") == 0) {
+            if (strcmp(value, "id") == 0) {
+                query->sort = SORT_ID;
+            } else if (strcmp(value, "next") == 0) {
+                query->sort = SORT_NEXT_DUE;
+            } else if (strcmp(value, "last") == 0) {
+                query->sort = SORT_LAST_RUN;
+            } else if (strcmp(value, "status") == 0) {
+                query->sort = SORT_STATUS;
+            } else if (strcmp(value, "interval") == 0) {
+                query->sort = SORT_INTERVAL;
+            } else {
+                printf("Unknown sort field '%s'.\n", value);
+                return 1;
+            }
+        } else if (strcmp(opt, "--limit") == 0) {
+            query->limit = atoi(value);
+        } else if (strcmp(opt, "--offset") == 0) {
+            query->offset = atoi(value);
+        } else if (strcmp(opt, "--format") == 0) {
+            if (strcmp(value, "box") == 0) {
+                *format = FORMAT_BOX;
+            } else if (strcmp(value, "compact") == 0) {
+                *format = FORMAT_COMPACT;
+            } else if (strcmp(value, "json") == 0) {
+                *format = FORMAT_JSON;
+            } else {
+                printf("Unknown format '%s'.\n", value);
+                return 1;
+            }
+        } else {
+            printf("Unknown option '%s'.\n", opt);
+            return 1;
+        }
+    }
+
+    if (query->limit < 0 || query->offset < 0) {
+        printf("Limit and offset must not be negative.\n");
+        return 1;
+    }
+    return 0;
+}
 
 
 int main(int argc, char *argv[]) {
-    // Load tasks from memory
-    load_tasks();
-   
+    // Launcher process started by the scheduler, must not load the task table
+    if (argc == 3 && strcmp(argv[1], LAUNCHER_COMMAND) == 0) {
+        return launcher_main(atoi(argv[2]));
+    }
+
     // Check if 2 arguments are passed in
     if (argc < 2) {
         // Return usage error
@@ -16,17 +153,34 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Load tasks from memory. Not for start: the scheduler forks its launcher before it loads
+    // the table, so the launcher never holds a copy of it.
+    if (strcmp(argv[1], "start") != 0) {
+        load_tasks();
+    }
+
 
     // ./flux list
     if (strcmp(argv[1], "list") == 0) {
-        if (argc != 2) {
-            printf("Usage: ./flux list\n");
+        TaskQuery query;
+        init_query(&query);
+        ListFormat format = FORMAT_BOX;
+
+        if (parse_list_options(argc, argv, &query, &format) != 0) {
+            printf("Usage: ./flux list [--tag <tag>] [--group <group>] [--active|--paused] [--status ok|failed|never|<n>]\n");
+            printf("                   [--due <seconds>] [--grep <text>] [--sort id|next|last|status|interval] [--desc]\n");
+            printf("                   [--limit <n>] [--offset <n>] [--format box|compact|json]\n");
             return 1;
         }
 
         load_tasks();
 
-        display_task();
+        // Keep the original output when no options are given
+        if (argc == 2) {
+            display_task();
+        } else {
+            list_tasks(&query, format);
+        }
         return 0;
     }
 
@@ -37,7 +191,12 @@ int main(int argc, char *argv[]) {
             printf("Usage: ./flux start\n");
             return 1;
         }
-        
+
+        // Claim the scheduler lock before forking so a second start fails right here
+        if (store_claim_daemon() < 0) {
+            printf("Another scheduler is already running.\n");
+            return 1;
+        }
 
        pid_t pid = fork();
 
@@ -45,7 +204,6 @@ int main(int argc, char *argv[]) {
             perror("Failed to start scheduler");
             return 1;
         } else if (pid == 0) {
-            load_tasks();
             int indicator = scheduler();
             exit(indicator);
         } else {
@@ -68,6 +226,12 @@ int main(int argc, char *argv[]) {
         } else {
             printf("Scheduler is not running.\n");
         }
+
+        // Show the load signal used to hold back low priority tasks
+        const char *source;
+        double load = host_load(&source);
+        const char *levels[] = { "normal", "busy (low priority deferred)", "saturated (only critical runs)" };
+        printf("Host load: %.1f%% (%s), %s\n", load, source, levels[load_level(load)]);
         return 0;
     }
 
@@ -87,13 +251,100 @@ int main(int argc, char *argv[]) {
 
     // ./flux add
     else if (strcmp(argv[1], "add") == 0) {
-        if (argc != 4) {
-            printf("Usage: ./flux add \"<command>\" <interval_in_seconds>\n");
+        if (argc < 4 || argc % 2 != 0) {
+            printf("Usage: ./flux add \"<command>\" <interval_in_seconds> [--tags <a,b>] [--group <group>]\n");
+            printf("                  [--cwd <dir>] [--env NAME=value]... [--umask <octal>]\n");
+            printf("                  [--priority critical|normal|low] [--deadline <seconds>]\n");
+            printf("                  [--watch <path>] [--debounce <ms>]   (interval 0: only run when triggered)\n");
             return 1;
         }
 
         char *command = argv[2];
         int interval = atoi(argv[3]);
+        const char *tags = NULL;
+        const char *group = NULL;
+        const char *cwd = NULL;
+        char env[MAX_ENV_LEN] = "";
+        int mask = UMASK_INHERIT;
+        Priority priority = PRIORITY_NORMAL;
+        int deadline = 0;
+        const char *watch = "";
+        int debounce = DEFAULT_DEBOUNCE_MS;
+
+        // Optional settings after the interval
+        for (int i = 4; i < argc; i += 2) {
+            if (strcmp(argv[i], "--tags") == 0) {
+                tags = argv[i + 1];
+            } else if (strcmp(argv[i], "--group") == 0) {
+                group = argv[i + 1];
+            } else if (strcmp(argv[i], "--cwd") == 0) {
+                cwd = argv[i + 1];
+                if (strlen(cwd) >= MAX_PATH_LEN || !valid_field(cwd)) {
+                    printf("Invalid working directory '%s'.\n", cwd);
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--env") == 0) {
+                // Overrides are joined with ';'
+                if (!valid_env_entry(argv[i + 1]) || !valid_field(argv[i + 1])) {
+                    printf("Environment overrides must look like NAME=value (without ';').\n");
+                    return 1;
+                }
+                if (strlen(env) + strlen(argv[i + 1]) + 2 > sizeof(env)) {
+                    printf("Too many environment overrides.\n");
+                    return 1;
+                }
+                if (env[0] != '\0') {
+                    strcat(env, ";");
+                }
+                strcat(env, argv[i + 1]);
+            } else if (strcmp(argv[i], "--umask") == 0) {
+                char *end;
+                long value = strtol(argv[i + 1], &end, 8);
+                if (*end != '\0' || value < 0 || value > 0777) {
+                    printf("Umask must be an octal number like 022.\n");
+                    return 1;
+                }
+                mask = (int)value;
+            } else if (strcmp(argv[i], "--priority") == 0) {
+                if (parse_priority(argv[i + 1], &priority) != 0) {
+                    printf("Priority must be critical, normal or low.\n");
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--deadline") == 0) {
+                deadline = atoi(argv[i + 1]);
+                if (deadline <= 0) {
+                    printf("Deadline must be a positive number of seconds.\n");
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--watch") == 0) {
+                watch = argv[i + 1];
+                if (watch[0] == '\0' || strlen(watch) >= MAX_PATH_LEN || !valid_field(watch)) {
+                    printf("Invalid watch path '%s'.\n", watch);
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--debounce") == 0) {
+                char *end;
+                long value = strtol(argv[i + 1], &end, 10);
+                if (*end != '\0' || end == argv[i + 1] || value < 0 || value > 3600000) {
+                    printf("Debounce must be a number of milliseconds.\n");
+                    return 1;
+                }
+                debounce = (int)value;
+            } else {
+                printf("Unknown option '%s'.\n", argv[i]);
+                return 1;
+            }
+        }
+
+        if ((tags && !valid_label(tags, true)) || (group && !valid_label(group, false))) {
+            printf("Tags and groups may only use letters, digits, '-', '_' and '.' (tags are comma separated).\n");
+            return 1;
+        }
+
+        if (!valid_command(command)) {
+            printf("Commands must be a single line shorter than %d bytes and can't contain '█'.\n", MAX_COMMAND_LEN);
+            return 1;
+        }
 
         if (!command_exists(command)) {
             printf("Command '%s' not found on system. Task could not be added.\n", command);
@@ -101,20 +352,39 @@ int main(int argc, char *argv[]) {
         }
 
 
-        if (interval <= 0) {
-            printf("Interval must be a positive number.\n");
+        // An interval of 0 means the task only runs on changes to its path or with 'flux run'
+        if (interval < 0 || (interval == 0 && strcmp(argv[3], "0") != 0)) {
+            printf("Interval must be a positive number, or 0 for tasks that only run when triggered.\n");
             return 1;
         }
 
-        int indicator = add_task(command, interval);
+        int indicator;
+        int attempts = 0;
+        do {
+            load_tasks();
+            indicator = add_task(command, interval);
+            if (indicator != -1) {
+                set_task_labels(indicator, tags, group);
+                set_task_environment(indicator, cwd, env, mask);
+                set_task_priority(indicator, priority, deadline);
+                set_task_trigger(indicator, watch, debounce);
+            }
+        } while (indicator != -1 && save_retry(&attempts));
 
         if (indicator == -1) {
             printf("Task could not be added. Too many tasks. Delete existing tasks to continue.\n");
             return 1;
+        } else if (save_failed) {
+            return 1;
         } else {
-            save_tasks();
             printf("\n\nTask of '%s' with ID of %d has been added.\n\n", command, indicator);
-            printf("Recently added task will occur every %d seconds. Run scheduler to begin.\n\n\n", interval);
+            if (interval > 0) {
+                printf("Recently added task will occur every %d seconds. Run scheduler to begin.\n\n\n", interval);
+            } else if (watch[0] != '\0') {
+                printf("Recently added task will run when '%s' changes. Run scheduler to begin.\n\n\n", watch);
+            } else {
+                printf("Recently added task will run on './flux run %d'. Run scheduler to begin.\n\n\n", indicator);
+            }
         }
 
     }
@@ -126,13 +396,18 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         
-        load_tasks(); 
         int task_id = atoi(argv[2]);
 
-        int indicator = delete_task(task_id);
+        int indicator;
+        int attempts = 0;
+        do {
+            load_tasks();
+            indicator = delete_task(task_id);
+        } while (indicator == 0 && save_retry(&attempts));
 
-        if (indicator == 0) {
-            save_tasks();
+        if (indicator == 0 && save_failed) {
+            return 1;
+        } else if (indicator == 0) {
             printf("Task with ID %d has been deleted successfully.\n", task_id);
         } else {
             printf("Could not delete task. No task found with ID of %d.\n", task_id);
@@ -142,18 +417,39 @@ int main(int argc, char *argv[]) {
 
     // ./flux pause
     else if (strcmp(argv[1], "pause") == 0) {
+        // ./flux pause --tag <tag>
+        if (argc == 4 && strcmp(argv[2], "--tag") == 0) {
+            int changed;
+            int attempts = 0;
+            do {
+                load_tasks();
+                changed = set_active_by_tag(argv[3], false);
+            } while (changed > 0 && save_retry(&attempts));
+
+            if (save_failed) {
+                return 1;
+            }
+            printf("Paused %d task(s) tagged '%s'.\n", changed, argv[3]);
+            return 0;
+        }
+
         if (argc != 3) {
-            printf("Usage: ./flux pause <task_id>\n");
+            printf("Usage: ./flux pause <task_id> | --tag <tag>\n");
             return 1;
         }
 
-        load_tasks(); 
         int task_id = atoi(argv[2]);
 
-        int indicator = pause_task(task_id);
+        int indicator;
+        int attempts = 0;
+        do {
+            load_tasks();
+            indicator = pause_task(task_id);
+        } while (indicator == 0 && save_retry(&attempts));
 
-        if (indicator == 0) {
-            save_tasks();
+        if (indicator == 0 && save_failed) {
+            return 1;
+        } else if (indicator == 0) {
             printf("Task with ID %d has been paused successfully.\n", task_id);
         } else if (indicator == -1) {
             printf("Task with ID of %d is already paused.\n", task_id);
@@ -164,18 +460,39 @@ int main(int argc, char *argv[]) {
 
     // ./flux resume
     else if (strcmp(argv[1], "resume") == 0) {
+        // ./flux resume --tag <tag>
+        if (argc == 4 && strcmp(argv[2], "--tag") == 0) {
+            int changed;
+            int attempts = 0;
+            do {
+                load_tasks();
+                changed = set_active_by_tag(argv[3], true);
+            } while (changed > 0 && save_retry(&attempts));
+
+            if (save_failed) {
+                return 1;
+            }
+            printf("Resumed %d task(s) tagged '%s'.\n", changed, argv[3]);
+            return 0;
+        }
+
         if (argc != 3) {
-            printf("Usage: ./flux resume <task_id>\n");
+            printf("Usage: ./flux resume <task_id> | --tag <tag>\n");
             return 1;
         }
 
-        load_tasks(); 
         int task_id = atoi(argv[2]);
 
-        int indicator = resume_task(task_id);
+        int indicator;
+        int attempts = 0;
+        do {
+            load_tasks();
+            indicator = resume_task(task_id);
+        } while (indicator == 0 && save_retry(&attempts));
 
-        if (indicator == 0) {
-            save_tasks();
+        if (indicator == 0 && save_failed) {
+            return 1;
+        } else if (indicator == 0) {
             printf("Task with ID %d has resumed.\n", task_id);
         } else if (indicator == -1) {
             printf("Task with ID of %d is already active.\n", task_id);
@@ -184,25 +501,100 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // ./flux run
+    else if (strcmp(argv[1], "run") == 0) {
+        if (argc != 3 || atoi(argv[2]) <= 0) {
+            printf("Usage: ./flux run <task_id>\n");
+            return 1;
+        }
+
+        int task_id = atoi(argv[2]);
+        load_tasks();
+        if (!task_exists(task_id)) {
+            printf("Could not run task. No task found with ID of %d.\n", task_id);
+            return 1;
+        }
+
+        if (queue_run(task_id) != 0) {
+            perror("Failed to queue run");
+            return 1;
+        }
+        if (file_exists("scheduler.running")) {
+            printf("Task with ID %d will run now.\n", task_id);
+        } else {
+            printf("Task with ID %d will run once the scheduler starts.\n", task_id);
+        }
+    }
+
+    // ./flux tag
+    else if (strcmp(argv[1], "tag") == 0) {
+        if (argc != 4 && argc != 5) {
+            printf("Usage: ./flux tag <task_id> <a,b> [group]\n");
+            return 1;
+        }
+
+        int task_id = atoi(argv[2]);
+        const char *group = argc == 5 ? argv[4] : NULL;
+
+        if (!valid_label(argv[3], true) || (group && !valid_label(group, false))) {
+            printf("Tags and groups may only use letters, digits, '-', '_' and '.' (tags are comma separated).\n");
+            return 1;
+        }
+
+        int indicator;
+        int attempts = 0;
+        do {
+            load_tasks();
+            indicator = set_task_labels(task_id, argv[3], group);
+        } while (indicator == 0 && save_retry(&attempts));
+
+        if (indicator == 0 && save_failed) {
+            return 1;
+        } else if (indicator == 0) {
+            printf("Task with ID %d has been tagged '%s'.\n", task_id, argv[3]);
+        } else {
+            printf("Could not tag task. No task found with ID of %d.\n", task_id);
+        }
+    }
+
     else if (strcmp(argv[1], "history") == 0) {
-        // .flux history
-        if (argc == 2) {
-            display_history();
-        } 
-        // .flux history <id>
-        else if (argc == 3) {
-            int task_id = atoi(argv[2]);
-
-            if (task_id <= 0) {
-                printf("Invalid task ID provided.\n");
+        // ./flux history [--report|--follow] [id] [--all]
+        bool report = false;
+        bool follow = false;
+        bool include_archive = false;
+        int task_id = 0;
+
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--report") == 0) {
+                report = true;
+            } else if (strcmp(argv[i], "--follow") == 0) {
+                follow = true;
+            } else if (strcmp(argv[i], "--all") == 0) {
+                include_archive = true;
+            } else if (task_id == 0) {
+                task_id = atoi(argv[i]);
+
+                if (task_id <= 0) {
+                    printf("Invalid task ID provided.\n");
+                    return 1;
+                }
+            } else {
+                printf("Invalid arguments for history command.\n");
                 return 1;
             }
+        }
 
-            display_history_filtered(task_id);
-        } else {
-            printf("Invalid arguments for history command.\n");
+        if (report && follow) {
+            printf("Use either --report or --follow, not both.\n");
             return 1;
         }
+
+        if (follow) {
+            return history_follow(task_id);
+        } else if (report) {
+            return history_report(task_id, include_archive);
+        }
+        history_print(task_id, include_archive);
         return 0;
     }
 
@@ -211,6 +603,68 @@ int main(int argc, char *argv[]) {
         archive_logs();
     }
 
+    // ./flux trace --duration <seconds>
+    else if (strcmp(argv[1], "trace") == 0) {
+        if (argc != 4 || strcmp(argv[2], "--duration") != 0 || atoi(argv[3]) <= 0) {
+            printf("Usage: ./flux trace --duration <seconds>\n");
+            return 1;
+        }
+        int duration = atoi(argv[3]);
+
+        if (!file_exists("scheduler.running")) {
+            printf("Scheduler is not running. Run './flux start' first.\n");
+            return 1;
+        }
+
+        // One trace at a time, a second request would overwrite the first & both would get
+        // whichever trace.json came out first. The lock goes away when this process exits.
+        int lock = open(TRACE_LOCK_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (lock < 0 || flock(lock, LOCK_EX | LOCK_NB) != 0) {
+            printf("Another trace is already running. Try again once it has finished.\n");
+            return 1;
+        }
+
+        // Ask the scheduler for a trace
+        remove(TRACE_OUTPUT_FILE);
+        FILE *request = fopen(TRACE_REQUEST_FILE, "w");
+        if (!request) {
+            perror("Failed to request trace");
+            return 1;
+        }
+        fprintf(request, "%d\n", duration);
+        fclose(request);
+
+        // The scheduler removes the request when it starts tracing (it checks about once a second).
+        // A trace still running for a CLI that gave up keeps it from being picked up.
+        int picked = 0;
+        while (file_exists(TRACE_REQUEST_FILE) && picked < 50) {
+            usleep(100000);
+            picked++;
+        }
+        if (file_exists(TRACE_REQUEST_FILE)) {
+            remove(TRACE_REQUEST_FILE);
+            printf("Scheduler didn't start the trace, it may still be finishing an earlier one.\n");
+            return 1;
+        }
+        // Anything written before the request was picked up came from an earlier trace
+        remove(TRACE_OUTPUT_FILE);
+
+        printf("Tracing scheduler for %d seconds...\n", duration);
+
+        // Wait for the scheduler to write the trace (plus a few seconds of slack)
+        for (int waited = 0; waited < (duration + 5) * 10; waited++) {
+            if (file_exists(TRACE_OUTPUT_FILE)) {
+                printf("Trace written to '%s'. Open it in ui.perfetto.dev or chrome://tracing.\n", TRACE_OUTPUT_FILE);
+                return 0;
+            }
+            usleep(100000);
+        }
+
+        remove(TRACE_REQUEST_FILE);
+        printf("Scheduler did not produce a trace in time.\n");
+        return 1;
+    }
+
     // ./flux help
     else if (strcmp(argv[1], "help") == 0) {
         print_usage();
@@ -0,0 +1,330 @@
+#include "store.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define STATE_MAGIC 0x464c5853u
+// Slots in the state table (power of 2, at least twice the max number of tasks)
+#define STATE_SLOTS 32768
+// How often a reader retries before giving up on the state file
+#define MAX_READ_ATTEMPTS 1000
+
+// Last run & skip of one task, id 0 marks an empty slot
+typedef struct {
+    _Atomic int32_t id;
+    _Atomic int32_t status;
+    _Atomic int64_t last_run;
+    _Atomic int64_t skipped_at;
+} StateSlot;
+
+// A reader's copy of a task's slot
+typedef struct {
+    bool found;
+    int status;
+    time_t last_run;
+    time_t skipped_at;
+} StateCopy;
+
+// Layout of the state file. seq is odd while the scheduler is writing (seqlock),
+// so readers copy without locking & retry if seq changed underneath them.
+typedef struct {
+    uint32_t magic;
+    uint32_t slot_count;
+    _Atomic uint64_t seq;
+    _Atomic uint32_t used;
+    uint32_t reserved;
+    StateSlot slots[STATE_SLOTS];
+} StateTable;
+
+// Writer lock held by this process & how many times it was taken
+static int writer_lock = -1;
+static int writer_depth = 0;
+
+// Scheduler lock once claimed, kept open until the process exits
+static int daemon_lock = -1;
+
+static StateTable *table = NULL;
+static bool table_writable = false;
+
+
+// Open & flock a lock file, returns the descriptor or -1
+static int lock_file(const char *filename, int operation) {
+    int fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    while (flock(fd, operation) != 0) {
+        // Retry if a signal interrupted the wait
+        if (errno == EINTR) {
+            continue;
+        }
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+int store_lock() {
+    // Nested calls share the lock, a second flock in the same process would wait on itself
+    if (writer_depth == 0) {
+        writer_lock = lock_file(LOCK_FILE, LOCK_EX);
+        if (writer_lock < 0) {
+            return -1;
+        }
+    }
+    writer_depth++;
+    return writer_lock;
+}
+
+
+void store_unlock(int fd) {
+    if (fd < 0 || fd != writer_lock || writer_depth == 0) {
+        return;
+    }
+    if (--writer_depth == 0) {
+        flock(writer_lock, LOCK_UN);
+        close(writer_lock);
+        writer_lock = -1;
+    }
+}
+
+
+int store_claim_daemon() {
+    // Already ours (flock would conflict with a second descriptor in the same process)
+    if (daemon_lock < 0) {
+        daemon_lock = lock_file(DAEMON_LOCK_FILE, LOCK_EX | LOCK_NB);
+    }
+    return daemon_lock;
+}
+
+
+int state_open(bool writable) {
+    if (table != NULL && (table_writable || !writable)) {
+        return 0;
+    }
+
+    int fd = open(STATE_FILE, writable ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    bool fresh = st.st_size == 0;
+    if (writable && st.st_size != sizeof(StateTable)) {
+        // New or from a different layout, start over
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, sizeof(StateTable)) != 0) {
+            close(fd);
+            return -1;
+        }
+        fresh = true;
+    } else if (st.st_size != sizeof(StateTable)) {
+        close(fd);
+        return -1;
+    }
+
+    void *data = mmap(NULL, sizeof(StateTable), writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+
+    StateTable *mapped = data;
+    if (writable) {
+        if (fresh || mapped->magic != STATE_MAGIC || mapped->slot_count != STATE_SLOTS) {
+            memset(mapped, 0, sizeof(StateTable));
+            mapped->magic = STATE_MAGIC;
+            mapped->slot_count = STATE_SLOTS;
+        }
+        // A scheduler that died mid-write could have left seq odd
+        uint64_t seq = atomic_load(&mapped->seq);
+        if (seq & 1) {
+            atomic_store(&mapped->seq, seq + 1);
+        }
+    } else if (mapped->magic != STATE_MAGIC || mapped->slot_count != STATE_SLOTS) {
+        munmap(data, sizeof(StateTable));
+        return -1;
+    }
+
+    if (table != NULL) {
+        munmap(table, sizeof(StateTable));
+    }
+    table = mapped;
+    table_writable = writable;
+    return 0;
+}
+
+
+static uint32_t first_slot(int id) {
+    return ((uint32_t)id * 2654435761u) & (STATE_SLOTS - 1);
+}
+
+
+// Mark the start of a write, readers retry until write_end
+static void write_begin() {
+    uint64_t seq = atomic_load_explicit(&table->seq, memory_order_relaxed);
+    atomic_store_explicit(&table->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+
+static void write_end() {
+    uint64_t seq = atomic_load_explicit(&table->seq, memory_order_relaxed);
+    atomic_store_explicit(&table->seq, seq + 1, memory_order_release);
+}
+
+
+// Store a task's values in its slot, must be called between write_begin & write_end
+static void put_slot(int id, time_t last_run, int status, time_t skipped_at) {
+    uint32_t slot = first_slot(id);
+    for (int probes = 0; probes < STATE_SLOTS; probes++) {
+        StateSlot *entry = &table->slots[slot];
+        int32_t current = atomic_load_explicit(&entry->id, memory_order_relaxed);
+
+        if (current == id || current == 0) {
+            atomic_store_explicit(&entry->last_run, (int64_t)last_run, memory_order_relaxed);
+            atomic_store_explicit(&entry->status, status, memory_order_relaxed);
+            atomic_store_explicit(&entry->skipped_at, (int64_t)skipped_at, memory_order_relaxed);
+            if (current == 0) {
+                atomic_store_explicit(&entry->id, id, memory_order_relaxed);
+                atomic_fetch_add_explicit(&table->used, 1, memory_order_relaxed);
+            }
+            return;
+        }
+        slot = (slot + 1) & (STATE_SLOTS - 1);
+    }
+}
+
+
+void state_write(int id, time_t last_run, int status, time_t skipped_at) {
+    if (table == NULL || !table_writable || id <= 0) {
+        return;
+    }
+    write_begin();
+    put_slot(id, last_run, status, skipped_at);
+    write_end();
+}
+
+
+// Find a task's slot, returns NULL if it has none
+static StateSlot *find_slot(int id) {
+    uint32_t slot = first_slot(id);
+    for (int probes = 0; probes < STATE_SLOTS; probes++) {
+        StateSlot *entry = &table->slots[slot];
+        int32_t current = atomic_load_explicit(&entry->id, memory_order_relaxed);
+        if (current == id) {
+            return entry;
+        }
+        if (current == 0) {
+            return NULL;
+        }
+        slot = (slot + 1) & (STATE_SLOTS - 1);
+    }
+    return NULL;
+}
+
+
+int state_overlay(Task *tasks, int count) {
+    // No state file yet (or from an older layout), tasks.txt has the latest values
+    if (table == NULL && state_open(false) != 0) {
+        return 0;
+    }
+    if (count <= 0) {
+        return 0;
+    }
+
+    // Values are read into a copy first, a pass that raced with the scheduler is thrown away
+    StateCopy *copy = malloc((size_t)count * sizeof(StateCopy));
+    if (copy == NULL) {
+        return -1;
+    }
+
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++) {
+        uint64_t before = atomic_load_explicit(&table->seq, memory_order_acquire);
+        // Scheduler is mid-write, try again
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            StateSlot *entry = find_slot(tasks[i].id);
+            copy[i].found = entry != NULL;
+            if (entry != NULL) {
+                copy[i].last_run = (time_t)atomic_load_explicit(&entry->last_run, memory_order_relaxed);
+                copy[i].status = atomic_load_explicit(&entry->status, memory_order_relaxed);
+                copy[i].skipped_at = (time_t)atomic_load_explicit(&entry->skipped_at, memory_order_relaxed);
+            }
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t after = atomic_load_explicit(&table->seq, memory_order_relaxed);
+        if (before != after) {
+            continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            // tasks.txt can be newer if the state file was recreated
+            if (copy[i].found && copy[i].last_run >= tasks[i].last_run) {
+                tasks[i].last_run = copy[i].last_run;
+                tasks[i].last_status = copy[i].status;
+                tasks[i].skipped_at = copy[i].skipped_at;
+            }
+        }
+        free(copy);
+        return 0;
+    }
+
+    // Never got a consistent copy, tasks keep the values from tasks.txt
+    free(copy);
+    return -1;
+}
+
+
+void state_prune(const Task *tasks, int count) {
+    if (table == NULL || !table_writable) {
+        return;
+    }
+    if (atomic_load_explicit(&table->used, memory_order_relaxed) < STATE_SLOTS / 2) {
+        return;
+    }
+
+    // Rebuild the table with only the tasks that still exist
+    static StateSlot live[STATE_SLOTS];
+    int live_count = 0;
+    for (int i = 0; i < count && live_count < STATE_SLOTS; i++) {
+        StateSlot *entry = find_slot(tasks[i].id);
+        if (entry != NULL) {
+            live[live_count].id = tasks[i].id;
+            live[live_count].status = atomic_load_explicit(&entry->status, memory_order_relaxed);
+            live[live_count].last_run = atomic_load_explicit(&entry->last_run, memory_order_relaxed);
+            live[live_count].skipped_at = atomic_load_explicit(&entry->skipped_at, memory_order_relaxed);
+            live_count++;
+        }
+    }
+
+    write_begin();
+    for (int i = 0; i < STATE_SLOTS; i++) {
+        atomic_store_explicit(&table->slots[i].id, 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&table->used, 0, memory_order_relaxed);
+    for (int i = 0; i < live_count; i++) {
+        put_slot(live[i].id, (time_t)live[i].last_run, live[i].status, (time_t)live[i].skipped_at);
+    }
+    write_end();
+}
@@ -0,0 +1,36 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include "task.h"
+
+// Lock taken by anything that rewrites tasks.txt (readers never take it)
+#define LOCK_FILE "tasks.lock"
+// Held by the running scheduler for its whole life
+#define DAEMON_LOCK_FILE "scheduler.lock"
+// Shared mapping holding last run times & exit codes written by the scheduler
+#define STATE_FILE "tasks.state"
+
+// Take the writer lock, blocks until it's free. Returns a descriptor for store_unlock or -1.
+// Can be nested, the lock is released by the matching outermost store_unlock.
+int store_lock();
+
+void store_unlock(int fd);
+
+// Claim the scheduler lock without waiting, returns -1 if another scheduler holds it.
+// The lock is inherited across fork(), so the CLI can claim it before starting the scheduler.
+int store_claim_daemon();
+
+// Map the state file, creating it when writable. Returns 0 on success.
+int state_open(bool writable);
+
+// Record a run or skip of a task (scheduler only)
+void state_write(int id, time_t last_run, int status, time_t skipped_at);
+
+// Copy last run times, exit codes & skips from the state file into loaded tasks. Returns -1,
+// leaving the tasks as they are, if the scheduler kept writing & no consistent copy was read.
+int state_overlay(Task *tasks, int count);
+
+// Drop entries of deleted tasks once the table starts filling up (scheduler only)
+void state_prune(const Task *tasks, int count);
+
+#endif
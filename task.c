@@ -1,28 +1,125 @@
 #include "task.h"
+#include "index.h"
+#include "store.h"
+#include "launcher.h"
+#include "trace.h"
+#include "load.h"
+#include "trigger.h"
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 
-#define MAX_TASKS 100
-#define MAX_COMMAND_LEN 256
+// Upper bound on the task table, it only guards against runaway task files. Memory is
+// allocated for the tasks that are actually loaded.
+#define MAX_TASKS 10000
+#define MAX_FIELDS 15
+// Time a scheduler loop may spend on non-critical tasks before checking for critical ones again
+#define TICK_BUDGET_MS 1000
+// Non-critical runs at once, more wait for one of them to finish. Critical runs don't count.
+#define MAX_BACKGROUND_RUNS 8
 #define DELIMITER "█"
-#define TASK_FILE "tasks.txt"
-#define LOG_FILE "task_logs.txt"
-#define ARCHIVE_DIR "archive"
 
-static Task tasks[MAX_TASKS];  
+// Task table, grown by reserve_tasks() together with the per position arrays below
+static Task *tasks = NULL;
+static int task_capacity = 0;
+// Positions of tasks that are due in the current scheduler loop
+static int *ready = NULL;
+// Per position: already in ready[] this loop, and whether a trigger asked for the run
+#define READY_QUEUED 1
+#define READY_TRIGGERED 2
+static unsigned char *ready_flags = NULL;
+// Ids of tasks whose triggers fired this loop
+static int *fired = NULL;
+// Time the current loop started, used when comparing deadlines
+static time_t deadline_now;
 static int task_count = 0;    
 static int next_id = 1;
+// Version of tasks.txt that was loaded, save_tasks() refuses to overwrite a newer one
+static unsigned long loaded_version = 0;
+
+// Identifies the task file that was loaded so the scheduler can skip unchanged reloads
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+} FileIdentity;
+static FileIdentity loaded_identity;
+
+// A run handed to the launcher that hasn't finished yet. Tasks can be reloaded or deleted
+// while they run, so it keeps what the log needs.
+typedef struct {
+    int run_id;
+    int task_id;
+    bool critical;
+    time_t started;
+    struct timespec began;
+    char command[MAX_COMMAND_LEN];
+} ActiveRun;
+static ActiveRun *active_runs = NULL;
+static int active_count = 0;
+static int active_capacity = 0;
+
+static bool reload_tasks();
+
+// Set whenever tasks[] changes so the indexes get rebuilt before the next query
+static bool index_dirty = true;
+
+
+// Make room for count tasks, returns 0 on success & -1 when out of memory or over MAX_TASKS
+static int reserve_tasks(int count) {
+    if (count <= task_capacity) {
+        return 0;
+    }
+    if (count > MAX_TASKS) {
+        return -1;
+    }
+    int capacity = task_capacity ? task_capacity * 2 : 64;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    if (capacity > MAX_TASKS) {
+        capacity = MAX_TASKS;
+    }
+
+    Task *grown_tasks = realloc(tasks, (size_t)capacity * sizeof(Task));
+    if (grown_tasks == NULL) {
+        return -1;
+    }
+    tasks = grown_tasks;
+    int *grown_ready = realloc(ready, (size_t)capacity * sizeof(int));
+    if (grown_ready == NULL) {
+        return -1;
+    }
+    ready = grown_ready;
+    unsigned char *grown_flags = realloc(ready_flags, (size_t)capacity);
+    if (grown_flags == NULL) {
+        return -1;
+    }
+    memset(grown_flags + task_capacity, 0, (size_t)(capacity - task_capacity));
+    ready_flags = grown_flags;
+    int *grown_fired = realloc(fired, (size_t)capacity * sizeof(int));
+    if (grown_fired == NULL) {
+        return -1;
+    }
+    fired = grown_fired;
+    task_capacity = capacity;
+    // The indexes point into the table
+    index_dirty = true;
+    return 0;
+}
 
 
 // Add a new task, return task id on success, -1 if full
 int add_task(const char *command, int interval_seconds) {
    // Check if there's space left to add task
-   if (task_count >= MAX_TASKS) {
+   if (reserve_tasks(task_count + 1) != 0) {
         // Returns -1 on failure (no space left)
         return -1;
     }
@@ -40,59 +137,617 @@ int add_task(const char *command, int interval_seconds) {
     t->interval_seconds = interval_seconds;
     // Initialize last_run (task hasn't run yet)
     t->last_run = 0;
+    t->skipped_at = 0;
     // Mark task as active
     t->active = true;
+    // No tags or group until the user sets them
+    t->tags[0] = '\0';
+    t->group[0] = '\0';
+    t->last_status = STATUS_NONE;
+    // Run from the scheduler's directory & environment by default
+    t->cwd[0] = '\0';
+    t->env[0] = '\0';
+    t->umask = UMASK_INHERIT;
+    // Normal priority, deadline of one interval
+    t->priority = PRIORITY_NORMAL;
+    t->deadline_seconds = 0;
+    // No path to watch
+    t->watch[0] = '\0';
+    t->debounce_ms = DEFAULT_DEBOUNCE_MS;
 
     // Increase count of stored tasks
     task_count++;
+    index_dirty = true;
 
     // Return new task's id
     return t->id;
 }
 
 
+// Set tags & group of a task, NULL leaves that field unchanged. Returns 0 on success, 1 if not found
+int set_task_labels(int given_id, const char *tags, const char *group) {
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].id == given_id) {
+            if (tags != NULL) {
+                strncpy(tasks[i].tags, tags, MAX_TAGS_LEN - 1);
+                tasks[i].tags[MAX_TAGS_LEN - 1] = '\0';
+            }
+            if (group != NULL) {
+                strncpy(tasks[i].group, group, MAX_GROUP_LEN - 1);
+                tasks[i].group[MAX_GROUP_LEN - 1] = '\0';
+            }
+            index_dirty = true;
+            return 0;
+        }
+    }
+
+    // Return 1 if no task with given ID was found
+    return 1;
+}
+
+
+// Set working directory, environment overrides & umask of a task. NULL/UMASK_KEEP leave a
+// field unchanged. Returns 0 on success, 1 if not found
+int set_task_environment(int given_id, const char *cwd, const char *env, int mask) {
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].id == given_id) {
+            if (cwd != NULL) {
+                strncpy(tasks[i].cwd, cwd, MAX_PATH_LEN - 1);
+                tasks[i].cwd[MAX_PATH_LEN - 1] = '\0';
+            }
+            if (env != NULL) {
+                strncpy(tasks[i].env, env, MAX_ENV_LEN - 1);
+                tasks[i].env[MAX_ENV_LEN - 1] = '\0';
+            }
+            if (mask != UMASK_KEEP) {
+                tasks[i].umask = mask;
+            }
+            return 0;
+        }
+    }
+
+    // Return 1 if no task with given ID was found
+    return 1;
+}
+
+
+// Set priority class & deadline of a task. Returns 0 on success, 1 if not found
+int set_task_priority(int given_id, Priority priority, int deadline_seconds) {
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].id == given_id) {
+            tasks[i].priority = priority;
+            tasks[i].deadline_seconds = deadline_seconds;
+            return 0;
+        }
+    }
+
+    // Return 1 if no task with given ID was found
+    return 1;
+}
+
+
+// Set the path whose changes run a task (empty for none). Returns 0 on success, 1 if not found
+int set_task_trigger(int given_id, const char *watch, int debounce_ms) {
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].id == given_id) {
+            strncpy(tasks[i].watch, watch, MAX_PATH_LEN - 1);
+            tasks[i].watch[MAX_PATH_LEN - 1] = '\0';
+            tasks[i].debounce_ms = debounce_ms;
+            return 0;
+        }
+    }
+
+    // Return 1 if no task with given ID was found
+    return 1;
+}
+
+
+bool task_exists(int given_id) {
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].id == given_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+const char *priority_name(Priority priority) {
+    switch (priority) {
+        case PRIORITY_CRITICAL: return "critical";
+        case PRIORITY_LOW: return "low";
+        default: return "normal";
+    }
+}
+
+
+// Parse a priority class name, returns 0 on success
+int parse_priority(const char *name, Priority *priority) {
+    if (strcmp(name, "critical") == 0) {
+        *priority = PRIORITY_CRITICAL;
+    } else if (strcmp(name, "normal") == 0) {
+        *priority = PRIORITY_NORMAL;
+    } else if (strcmp(name, "low") == 0) {
+        *priority = PRIORITY_LOW;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+
+// Check an environment override looks like NAME=value (no ';' since that separates overrides)
+bool valid_env_entry(const char *entry) {
+    const char *equals = strchr(entry, '=');
+    if (equals == NULL || equals == entry || strchr(entry, ';') != NULL || strchr(entry, '\n') != NULL) {
+        return false;
+    }
+    for (const char *c = entry; c < equals; c++) {
+        bool ok = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || *c == '_' ||
+                  (c != entry && *c >= '0' && *c <= '9');
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Print one task in the boxed format
+static void print_task_box(const Task *t) {
+    printf("\n=============================================================\n");
+    printf("Task ID:   %d\n", t->id);
+    printf("-------------------------------------------------------------\n");
+    printf("Command:   %s\n", t->command);
+    printf("-------------------------------------------------------------\n");
+    if (t->interval_seconds > 0) {
+        printf("Interval:  Every %d seconds\n", t->interval_seconds);
+    } else {
+        printf("Interval:  None (runs when triggered)\n");
+    }
+    printf("-------------------------------------------------------------\n");
+    if (t->watch[0] != '\0') {
+        printf("Watch:     %s (debounce %d ms)\n", t->watch, t->debounce_ms);
+        printf("-------------------------------------------------------------\n");
+    }
+    if (t->priority != PRIORITY_NORMAL || t->deadline_seconds > 0) {
+        printf("Priority:  %s\n", priority_name(t->priority));
+        if (t->deadline_seconds > 0) {
+            printf("Deadline:  Start within %d seconds of being due\n", t->deadline_seconds);
+        }
+        printf("-------------------------------------------------------------\n");
+    }
+    if (t->last_run == 0) {
+        printf("Last run:  Never\n");
+    } else {
+        printf("Last run:  %s", ctime(&(t->last_run)));
+    }
+    if (t->last_status != STATUS_NONE) {
+        printf("Exit code: %d\n", t->last_status);
+    }
+    if (t->skipped_at > t->last_run) {
+        printf("Skipped:   %s", ctime(&(t->skipped_at)));
+    }
+    printf("-------------------------------------------------------------\n");
+    if (t->tags[0] != '\0' || t->group[0] != '\0') {
+        printf("Tags:      %s\n", t->tags[0] ? t->tags : "-");
+        printf("Group:     %s\n", t->group[0] ? t->group : "-");
+        printf("-------------------------------------------------------------\n");
+    }
+    if (t->cwd[0] != '\0' || t->env[0] != '\0' || t->umask != UMASK_INHERIT) {
+        printf("Directory: %s\n", t->cwd[0] ? t->cwd : "(scheduler's)");
+        printf("Env:       %s\n", t->env[0] ? t->env : "-");
+        if (t->umask != UMASK_INHERIT) {
+            printf("Umask:     %03o\n", (unsigned)t->umask);
+        }
+        printf("-------------------------------------------------------------\n");
+    }
+    if (t->active){
+        printf("Status:    Enabled (will run when scheduler runs)\n");
+    } else {
+        printf("Status:   Paused\n");
+    }
+    printf("=============================================================\n\n");
+}
+
+
+// Print one task on a single line
+static void print_task_compact(const Task *t) {
+    char last[32] = "never";
+    if (t->last_run != 0) {
+        strftime(last, sizeof(last), "%Y-%m-%d %H:%M:%S", localtime(&t->last_run));
+    }
+
+    char status[16] = "-";
+    if (t->last_status != STATUS_NONE) {
+        snprintf(status, sizeof(status), "%d", t->last_status);
+    }
+
+    printf("%-6d %-7s %-8s %8ds  %-19s  %-6s %-12s %-16s %s\n",
+           t->id, t->active ? "active" : "paused", priority_name(t->priority), t->interval_seconds, last, status,
+           t->group[0] ? t->group : "-", t->tags[0] ? t->tags : "-", t->command);
+}
+
+
+// Print a string as a quoted JSON string
+static void print_json_string(const char *str) {
+    putchar('"');
+    for (const unsigned char *c = (const unsigned char *)str; *c != '\0'; c++) {
+        switch (*c) {
+            case '"':  fputs("\\\"", stdout); break;
+            case '\\': fputs("\\\\", stdout); break;
+            case '\n': fputs("\\n", stdout); break;
+            case '\r': fputs("\\r", stdout); break;
+            case '\t': fputs("\\t", stdout); break;
+            default:
+                if (*c < 0x20) {
+                    printf("\\u%04x", *c);
+                } else {
+                    putchar(*c);
+                }
+        }
+    }
+    putchar('"');
+}
+
+
+// Print one task as a JSON object
+static void print_task_json(const Task *t) {
+    printf("{\"id\":%d,\"command\":", t->id);
+    print_json_string(t->command);
+    printf(",\"interval\":%d,\"last_run\":%ld,\"next_due\":", t->interval_seconds, (long)t->last_run);
+    // Manual and watch-only tasks are never due on their own
+    if (t->interval_seconds > 0) {
+        printf("%ld", (long)next_due(t));
+    } else {
+        printf("null");
+    }
+    // A run the host was too busy for, only while no later run happened
+    if (t->skipped_at > t->last_run) {
+        printf(",\"skipped_at\":%ld", (long)t->skipped_at);
+    } else {
+        printf(",\"skipped_at\":null");
+    }
+    printf(",\"active\":%s,\"last_status\":", t->active ? "true" : "false");
+    if (t->last_status == STATUS_NONE) {
+        printf("null");
+    } else {
+        printf("%d", t->last_status);
+    }
+    printf(",\"priority\":\"%s\",\"deadline\":%d", priority_name(t->priority), t->deadline_seconds);
+    printf(",\"watch\":");
+    print_json_string(t->watch);
+    printf(",\"debounce_ms\":%d", t->debounce_ms);
+    printf(",\"group\":");
+    print_json_string(t->group);
+    printf(",\"cwd\":");
+    print_json_string(t->cwd);
+    printf(",\"env\":");
+    print_json_string(t->env);
+    // umask as an octal string like the text list shows it, null means inherit
+    if (t->umask != UMASK_INHERIT) {
+        printf(",\"umask\":\"%03o\"", (unsigned)t->umask);
+    } else {
+        printf(",\"umask\":null");
+    }
+    printf(",\"tags\":[");
+
+    // Split comma separated tags into a JSON array
+    const char *start = t->tags;
+    bool first = true;
+    while (*start != '\0') {
+        const char *end = strchr(start, ',');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        if (len > 0) {
+            char tag[MAX_TAGS_LEN];
+            memcpy(tag, start, len);
+            tag[len] = '\0';
+            printf(first ? "" : ",");
+            print_json_string(tag);
+            first = false;
+        }
+        if (end == NULL) {
+            break;
+        }
+        start = end + 1;
+    }
+    printf("]}");
+}
+
+
+// Make sure indexes match the current task array
+static void ensure_index() {
+    if (index_dirty) {
+        index_build(tasks, task_count);
+        index_dirty = false;
+    }
+}
+
+
 // Display all tasks added
 void display_task() {
     if (task_count != 0) {
         printf("\nAll tasks:\n");
         // Loop through all stored tasks & display formatted info
         for(int i = 0; i < task_count; i++) {
-            printf("\n=============================================================\n");
-            printf("Task ID:   %d\n", tasks[i].id);
-            printf("-------------------------------------------------------------\n");
-            printf("Command:   %s\n", tasks[i].command);
-            printf("-------------------------------------------------------------\n");
-            printf("Interval:  Every %d seconds\n", tasks[i].interval_seconds);
-            printf("-------------------------------------------------------------\n");
-            if (tasks[i].last_run == 0) {
-                printf("Last run:  Never\n");
-            } else {
-                printf("Last run:  %s", ctime(&(tasks[i].last_run)));
+            print_task_box(&tasks[i]);
+        }
+    } else {
+        printf("\nNo tasks currently available. Run '/flux add \"<command>\" <interval_in_seconds>' to add task.\n\n");
+    }
+}
+
+
+// Fill a query with defaults (no filters, sorted by ID, no limit)
+void init_query(TaskQuery *query) {
+    memset(query, 0, sizeof(*query));
+    query->state = STATE_ANY;
+    query->status = STATUS_ANY;
+    query->due_within = -1;
+    query->sort = SORT_ID;
+}
+
+
+// Display tasks matching a query, returns number of tasks matched
+int list_tasks(const TaskQuery *query, ListFormat format) {
+    ensure_index();
+
+    int *matches = malloc((task_count > 0 ? task_count : 1) * sizeof(int));
+    if (matches == NULL) {
+        perror("Failed to list tasks");
+        return 0;
+    }
+
+    int matched = index_query(query, time(NULL), matches);
+
+    // Apply pagination
+    int start = query->offset < matched ? query->offset : matched;
+    int end = matched;
+    if (query->limit > 0 && start + query->limit < end) {
+        end = start + query->limit;
+    }
+
+    if (format == FORMAT_JSON) {
+        printf("{\"total\":%d,\"offset\":%d,\"tasks\":[", matched, start);
+        for (int i = start; i < end; i++) {
+            if (i > start) {
+                printf(",");
             }
-            printf("-------------------------------------------------------------\n");
-            if (tasks[i].active){
-                printf("Status:    Enabled (will run when scheduler runs)\n");
+            print_task_json(&tasks[matches[i]]);
+        }
+        printf("]}\n");
+    } else if (matched == 0) {
+        printf("\nNo tasks match the given filters.\n\n");
+    } else {
+        if (format == FORMAT_COMPACT) {
+            printf("%-6s %-7s %-8s %9s  %-19s  %-6s %-12s %-16s %s\n",
+                   "ID", "STATE", "PRIORITY", "INTERVAL", "LAST RUN", "EXIT", "GROUP", "TAGS", "COMMAND");
+        }
+        for (int i = start; i < end; i++) {
+            if (format == FORMAT_COMPACT) {
+                print_task_compact(&tasks[matches[i]]);
             } else {
-                printf("Status:   Paused\n");
+                print_task_box(&tasks[matches[i]]);
             }
-            printf("=============================================================\n\n");
         }
-    } else {
-        printf("\nNo tasks currently available. Run '/flux add \"<command>\" <interval_in_seconds>' to add task.\n\n");
+        if (start != 0 || end != matched) {
+            printf("\nShowing %d-%d of %d tasks\n", end > start ? start + 1 : start, end, matched);
+        }
+    }
+
+    free(matches);
+    return matched;
+}
+
+
+// Convert a system() result into a shell style exit code
+static int exit_code(int status) {
+    if (status == -1) {
+        // Shell couldn't be started
+        return 127;
+    }
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return status;
+}
+
+
+// When a ready task should have started by: the time it became due plus its deadline
+// (defaults to one interval). Triggered runs became due when their trigger fired.
+static time_t task_deadline(const Task *t, time_t now) {
+    bool triggered = (ready_flags[t - tasks] & READY_TRIGGERED) != 0;
+    time_t due = (next_due(t) == 0 || triggered) ? now : next_due(t);
+    int deadline = t->deadline_seconds > 0 ? t->deadline_seconds : t->interval_seconds;
+    return due + deadline;
+}
+
+
+// Order ready tasks by priority class, then earliest deadline, then id
+static int compare_ready(const void *a, const void *b) {
+    const Task *x = &tasks[*(const int *)a];
+    const Task *y = &tasks[*(const int *)b];
+
+    if (x->priority != y->priority) {
+        return x->priority - y->priority;
+    }
+
+    time_t deadline_x = task_deadline(x, deadline_now);
+    time_t deadline_y = task_deadline(y, deadline_now);
+    if (deadline_x != deadline_y) {
+        return deadline_x < deadline_y ? -1 : 1;
+    }
+    return x->id - y->id;
+}
+
+
+// Append a line to the log file
+static void log_line(time_t when, const char *format, ...) {
+    FILE *txt = fopen(LOG_FILE, "a");
+    if (txt == NULL) {
+        return;
+    }
+
+    // Format timestamp
+    char timebuf[64];
+    strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S", localtime(&when));
+    fprintf(txt, "[%s] ", timebuf);
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(txt, format, args);
+    va_end(args);
+
+    // Close the file
+    fclose(txt);
+}
+
+
+// Log a finished run & record its last run
+static void record_run(const ActiveRun *run, int status) {
+    TRACE_BEGIN(run_start);
+    struct timespec ended;
+    clock_gettime(CLOCK_MONOTONIC, &ended);
+    long duration_ms = (ended.tv_sec - run->began.tv_sec) * 1000L + (ended.tv_nsec - run->began.tv_nsec) / 1000000L;
+    int last_status = exit_code(status);
+
+    // Log timestamp, task id, exit code, run time & the command that was run
+    TRACE_BEGIN(log_start);
+    log_line(run->started, "Ran task #%d (exit %d, %ld ms): %s\n", run->task_id, last_status, duration_ms, run->command);
+    TRACE_END(log_start, "log-write", run->task_id);
+
+    // Unless it was deleted while it ran
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].id == run->task_id) {
+            tasks[i].last_run = run->started;
+            tasks[i].last_status = last_status;
+            TRACE_BEGIN(update_start);
+            update_last_run(&tasks[i]);
+            TRACE_END(update_start, "update_last_run", run->task_id);
+            break;
+        }
+    }
+
+    TRACE_END(run_start, "run", run->task_id);
+}
+
+
+// Start a task through the launcher without waiting for it, finish_runs() logs it once it exits
+static void start_task(Task *t) {
+    if (active_count == active_capacity) {
+        int capacity = active_capacity ? active_capacity * 2 : 16;
+        ActiveRun *grown = realloc(active_runs, (size_t)capacity * sizeof(ActiveRun));
+        if (grown == NULL) {
+            return;
+        }
+        active_runs = grown;
+        active_capacity = capacity;
+    }
+
+    ActiveRun *run = &active_runs[active_count];
+    run->task_id = t->id;
+    run->critical = t->priority == PRIORITY_CRITICAL;
+    run->started = time(NULL);
+    clock_gettime(CLOCK_MONOTONIC, &run->began);
+    memcpy(run->command, t->command, sizeof(run->command));
+
+    TRACE_BEGIN(spawn_start);
+    run->run_id = launcher_submit(t);
+    TRACE_END(spawn_start, "spawn", t->id);
+
+    if (run->run_id < 0) {
+        record_run(run, -1);
+        return;
     }
+    active_count++;
+}
+
+
+// Log runs that have finished. With wait set, waits until every run has finished.
+static void finish_runs(bool wait) {
+    int status;
+    int run_id;
+    while ((run_id = launcher_collect(&status, wait)) > 0) {
+        for (int i = 0; i < active_count; i++) {
+            if (active_runs[i].run_id == run_id) {
+                record_run(&active_runs[i], status);
+                active_runs[i] = active_runs[--active_count];
+                break;
+            }
+        }
+    }
+}
+
+
+// Whether a task is running right now, a task never runs twice at once
+static bool is_running(int task_id) {
+    for (int i = 0; i < active_count; i++) {
+        if (active_runs[i].task_id == task_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Non-critical runs in progress
+static int background_runs() {
+    int count = 0;
+    for (int i = 0; i < active_count; i++) {
+        if (!active_runs[i].critical) {
+            count++;
+        }
+    }
+    return count;
+}
+
+
+// Give up on a run because the host is too busy, the task is next due one interval later.
+// last_run & the exit code still describe the last run that actually happened.
+static void skip_task(Task *t, time_t now) {
+    t->skipped_at = now;
+    log_line(now, "Skipped task #%d (host busy): %s\n", t->id, t->command);
+    update_last_run(t);
 }
 
 
 // Continuously loop in the background and run tasks
 int scheduler() {
+    // Only one scheduler may run at a time, the lock is held until the process exits
+    if (store_claim_daemon() < 0) {
+        printf("Another scheduler is already running.\n");
+        return 1;
+    }
+
+    // Shared state file where last run times get recorded
+    if (state_open(true) != 0) {
+        perror("Failed to open state file");
+        return 1;
+    }
+
+    // Start the launcher while this process is still small, tasks get spawned through it
+    if (launcher_start() != 0) {
+        perror("Failed to start launcher, running tasks directly");
+    }
+
     // Load tasks beforehand
     load_tasks();
 
     // No tasks to run
     if (task_count == 0) {
+        launcher_stop();
         return 1;
     }
 
+    // Wake up on changes to watched paths & for 'flux run' instead of polling
+    if (trigger_init() != 0) {
+        perror("Failed to watch for file changes, checking them periodically");
+    }
+    trigger_sync(tasks, task_count);
+
     // Create a "running" flag file to indicate scheduler is running
     FILE *flag = fopen("scheduler.running", "w");
     if (flag != NULL) {
@@ -108,57 +763,144 @@ int scheduler() {
             break;
         }
 
+        // Answer trace requests from 'flux trace'
+        trace_poll();
+
         // Load the most recent changes from file
-        load_tasks(); 
+        TRACE_BEGIN(reload_start);
+        if (reload_tasks()) {
+            state_prune(tasks, task_count);
+            trigger_sync(tasks, task_count);
+        }
+        TRACE_END(reload_start, "reload", -1);
+
+        // Log runs that finished since the last loop, their tasks become due again
+        finish_runs(false);
 
-        // Current time & if tasks has changed
+        // Current time
         time_t current_time = time(NULL);
-        bool changed = false;
+        struct timespec tick_start;
+        clock_gettime(CLOCK_MONOTONIC, &tick_start);
 
+        // Collect tasks that are due before running any of them
+        TRACE_BEGIN(due_start);
+        int ready_count = 0;
         for (int i = 0; i < task_count; i++) {
             // If task is paused, skip
             if (!tasks[i].active) {
                 continue;
             }
 
-            // Else if its time to run next task or it hasn't run before, run the command
-            if (tasks[i].last_run == 0 || 
-                (current_time - tasks[i].last_run) >= tasks[i].interval_seconds) {
-
-                system(tasks[i].command);
+            // Tasks without an interval only run when triggered, & a running task isn't due
+            if (tasks[i].interval_seconds <= 0 || is_running(tasks[i].id)) {
+                continue;
+            }
 
-                // Log the command
-                FILE *txt = fopen(LOG_FILE, "a");
+            // Else if its time to run next task or it hasn't run before, it's ready
+            if (next_due(&tasks[i]) <= current_time) {
+                ready_flags[i] = READY_QUEUED;
+                ready[ready_count++] = i;
+            }
+        }
 
-                // Format timestamp
-                char timebuf[64];
-                strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S", localtime(&current_time));
+        // Add runs asked for by watched paths & 'flux run', once per task even if also due
+        int fired_count = trigger_collect(fired, task_capacity);
+        for (int f = 0; f < fired_count; f++) {
+            for (int i = 0; i < task_count; i++) {
+                if (tasks[i].id != fired[f]) {
+                    continue;
+                }
+                if (!(ready_flags[i] & READY_QUEUED)) {
+                    ready[ready_count++] = i;
+                }
+                ready_flags[i] |= READY_QUEUED | READY_TRIGGERED;
+                break;
+            }
+        }
 
+        // Most important class first, earliest deadline first within a class
+        deadline_now = current_time;
+        qsort(ready, ready_count, sizeof(int), compare_ready);
 
-                // Log timestamp, task id, & the command that was run
-                fprintf(txt, "[%s] Ran task #%d: %s\n", timebuf, tasks[i].id, tasks[i].command);
-                // Close the file
-                fclose(txt);
+        // Check how busy the host is once per loop, only if something is due
+        LoadLevel level = ready_count > 0 ? load_level(host_load(NULL)) : LOAD_NORMAL;
+        TRACE_END(due_start, "due-check", -1);
 
+        int background = background_runs();
+        int r;
+        for (r = 0; r < ready_count; r++) {
+            Task *t = &tasks[ready[r]];
+            bool triggered = (ready_flags[ready[r]] & READY_TRIGGERED) != 0;
 
-                tasks[i].last_run = current_time;
-                changed = true;
+            // Triggered while it's still running, run it again once it's done
+            if (is_running(t->id)) {
+                trigger_requeue(t->id);
+                continue;
             }
-        }
 
-        if (changed) {
-            for (int i = 0; i < task_count; i++) {
-                if (tasks[i].last_run == current_time) {
-                    update_last_run(tasks[i].id, tasks[i].last_run);
+            if (t->priority != PRIORITY_CRITICAL) {
+                // Out of time for this loop, come back to critical tasks before running more
+                struct timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                long elapsed_ms = (now.tv_sec - tick_start.tv_sec) * 1000L + (now.tv_nsec - tick_start.tv_nsec) / 1000000L;
+                if (elapsed_ms >= TICK_BUDGET_MS) {
+                    break;
                 }
+
+                // Host is busy: hold back low priority work, when saturated normal work too
+                bool deferred = (t->priority == PRIORITY_LOW && level >= LOAD_BUSY) ||
+                                (t->priority == PRIORITY_NORMAL && level >= LOAD_SATURATED);
+                if (deferred) {
+                    // Triggered runs wait for the load to drop, they aren't due again on their own
+                    if (triggered) {
+                        trigger_requeue(t->id);
+                    }
+                    // Low priority runs that missed their deadline are dropped instead of piling up
+                    else if (t->priority == PRIORITY_LOW && task_deadline(t, current_time) <= current_time) {
+                        skip_task(t, current_time);
+                    }
+                    continue;
+                }
+
+                // Enough bulk work running, wait for some of it to finish
+                if (background >= MAX_BACKGROUND_RUNS) {
+                    if (triggered) {
+                        trigger_requeue(t->id);
+                    }
+                    continue;
+                }
+                background++;
             }
+
+            start_task(t);
         }
 
+        // Keep triggered runs the budget didn't reach for the next loop
+        bool left_over = r < ready_count;
+        for (; r < ready_count; r++) {
+            if (ready_flags[ready[r]] & READY_TRIGGERED) {
+                trigger_requeue(tasks[ready[r]].id);
+            }
+        }
+        for (r = 0; r < ready_count; r++) {
+            ready_flags[ready[r]] = 0;
+        }
 
-        // Sleep to be more effecient
-        sleep(1);
+        // Sleep until a trigger fires or a run finishes, at most a second so timed tasks stay on time
+        TRACE_BEGIN(wait_start);
+        long timeout_ms = left_over ? 0 : 1000;
+        long trigger_ms = trigger_next_ms();
+        if (trigger_ms >= 0 && trigger_ms < timeout_ms) {
+            timeout_ms = trigger_ms;
+        }
+        trigger_wait(timeout_ms, active_count > 0 ? launcher_wait_fd() : -1);
+        TRACE_END(wait_start, "wait", -1);
 }
 
+    // Runs still going are logged when they finish, like a run the stop came in during
+    finish_runs(true);
+    trigger_close();
+    launcher_stop();
     return 0;
 }
 
@@ -176,6 +918,7 @@ int delete_task(int given_id) {
 
             // Update task_count to reflect deletion of 1 task
                 task_count--;
+                index_dirty = true;
 
             // Return 0 if task is found & successfully deleted
             return 0;
@@ -198,6 +941,7 @@ for (int i = 0; i < task_count; i++) {
             }
             // Set active state of task to false
             tasks[i].active = false;
+            index_dirty = true;
 
             // Return 0 if task is found & successfully paused
             return 0;
@@ -219,6 +963,7 @@ for (int i = 0; i < task_count; i++) {
             }
             // Set active state of task to true
             tasks[i].active = true;
+            index_dirty = true;
 
             // Return 0 if task is found & successfully resume
             return 0;
@@ -230,33 +975,273 @@ for (int i = 0; i < task_count; i++) {
 }
 
 
-// Save tasks to allow for persistent storage when user quits (write to the .txt file)
-void save_tasks() {
-    // Open the file for writing (if exists, will be overwritten, if not, will be created) and create a pointer to it
-    FILE *txt = fopen(TASK_FILE, "w");
+// Pause or resume every task with a tag, returns number of tasks changed
+int set_active_by_tag(const char *tag, bool active) {
+    ensure_index();
+
+    // Go straight to the tasks carrying the tag instead of scanning all tasks
+    const int *positions;
+    int count = index_lookup_tag(tag, &positions);
+
+    int changed = 0;
+    for (int i = 0; i < count; i++) {
+        Task *t = &tasks[positions[i]];
+        if (t->active != active) {
+            t->active = active;
+            changed++;
+        }
+    }
+
+    if (changed > 0) {
+        index_dirty = true;
+    }
+    return changed;
+}
+
+
+// Check a tag/group name only uses safe characters (letters, digits, '-', '_', '.')
+bool valid_label(const char *label, bool allow_commas) {
+    if (label[0] == '\0') {
+        return false;
+    }
+    for (const char *c = label; *c != '\0'; c++) {
+        bool safe = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+                    (*c >= '0' && *c <= '9') || *c == '-' || *c == '_' || *c == '.';
+        if (!safe && !(allow_commas && *c == ',')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Check a value can be stored as a field of the task file: no delimiter & no line breaks
+bool valid_field(const char *value) {
+    return strstr(value, DELIMITER) == NULL && strchr(value, '\n') == NULL && strchr(value, '\r') == NULL;
+}
+
+
+// Check a command can be stored in the task file: one line, no delimiter & not truncated
+bool valid_command(const char *command) {
+    return command[0] != '\0' && strlen(command) < MAX_COMMAND_LEN && valid_field(command);
+}
+
+
+// Split a line on the full delimiter string. Unlike strtok this keeps empty fields
+// and doesn't treat each byte of the multi-byte delimiter as a separator.
+static int split_fields(char *line, char **fields, int max_fields) {
+    int count = 0;
+    char *start = line;
+    size_t delimiter_len = strlen(DELIMITER);
+
+    while (count < max_fields) {
+        fields[count++] = start;
+        char *end = strstr(start, DELIMITER);
+        if (end == NULL) {
+            break;
+        }
+        *end = '\0';
+        start = end + delimiter_len;
+    }
+    return count;
+}
+
+
+// Parse one line of the task file, returns 0 on success & -1 if the line is malformed
+int parse_task_line(char *line, Task *t) {
+    // Remove newline char (& a carriage return if the file was edited on Windows)
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        line[--len] = '\0';
+    }
+
+    char *fields[MAX_FIELDS];
+    int count = split_fields(line, fields, MAX_FIELDS);
+
+    // id, command, interval, last run & active state are required
+    if (count < 5 || fields[0][0] == '\0' || fields[1][0] == '\0') {
+        return -1;
+    }
+    // A line break inside a field means the line is corrupt
+    for (int i = 0; i < count; i++) {
+        if (!valid_field(fields[i])) {
+            return -1;
+        }
+    }
+
+    t->id = atoi(fields[0]);
+    strncpy(t->command, fields[1], MAX_COMMAND_LEN - 1);
+    t->command[MAX_COMMAND_LEN - 1] = '\0';
+    t->interval_seconds = atoi(fields[2]);
+    t->last_run = (time_t)atol(fields[3]);
+    // Skips only live in the state file
+    t->skipped_at = 0;
+    t->active = (atoi(fields[4]) != 0);
+
+    // Tags, group & last status were added later, older files don't have them
+    t->tags[0] = '\0';
+    t->group[0] = '\0';
+    t->last_status = STATUS_NONE;
+    if (count > 5) {
+        strncpy(t->tags, fields[5], MAX_TAGS_LEN - 1);
+        t->tags[MAX_TAGS_LEN - 1] = '\0';
+    }
+    if (count > 6) {
+        strncpy(t->group, fields[6], MAX_GROUP_LEN - 1);
+        t->group[MAX_GROUP_LEN - 1] = '\0';
+    }
+    if (count > 7 && fields[7][0] != '\0') {
+        t->last_status = atoi(fields[7]);
+    }
+
+    // Execution environment came after that
+    t->cwd[0] = '\0';
+    t->env[0] = '\0';
+    t->umask = UMASK_INHERIT;
+    if (count > 8) {
+        strncpy(t->cwd, fields[8], MAX_PATH_LEN - 1);
+        t->cwd[MAX_PATH_LEN - 1] = '\0';
+    }
+    if (count > 9) {
+        strncpy(t->env, fields[9], MAX_ENV_LEN - 1);
+        t->env[MAX_ENV_LEN - 1] = '\0';
+    }
+    if (count > 10 && fields[10][0] != '\0') {
+        t->umask = (int)strtol(fields[10], NULL, 8);
+    }
+
+    // Then priority & deadline
+    t->priority = PRIORITY_NORMAL;
+    t->deadline_seconds = 0;
+    if (count > 11 && fields[11][0] != '\0') {
+        int priority = atoi(fields[11]);
+        if (priority >= PRIORITY_CRITICAL && priority <= PRIORITY_LOW) {
+            t->priority = (Priority)priority;
+        }
+    }
+    if (count > 12 && atoi(fields[12]) > 0) {
+        t->deadline_seconds = atoi(fields[12]);
+    }
+
+    // Then the watched path
+    t->watch[0] = '\0';
+    t->debounce_ms = DEFAULT_DEBOUNCE_MS;
+    if (count > 13) {
+        strncpy(t->watch, fields[13], MAX_PATH_LEN - 1);
+        t->watch[MAX_PATH_LEN - 1] = '\0';
+    }
+    if (count > 14 && fields[14][0] != '\0' && atoi(fields[14]) >= 0) {
+        t->debounce_ms = atoi(fields[14]);
+    }
+
+    return 0;
+}
+
+
+// Text of a field as it's saved, a value that would break the line is saved empty
+static const char *field_text(const char *value) {
+    return valid_field(value) ? value : "";
+}
+
+
+// Write one task as a single line using █ as delimiter
+void write_task_line(FILE *txt, const Task *t) {
+    fprintf(txt, "%d█%s█%d█%ld█%d█%s█%s█%d█%s█%s█", t->id, field_text(t->command), t->interval_seconds,
+            (long)t->last_run, t->active, field_text(t->tags), field_text(t->group), t->last_status,
+            field_text(t->cwd), field_text(t->env));
+    // umask is stored in octal, empty means inherit
+    if (t->umask != UMASK_INHERIT) {
+        fprintf(txt, "%03o", (unsigned)t->umask);
+    }
+    fprintf(txt, "█%d█%d█%s█%d\n", (int)t->priority, t->deadline_seconds, field_text(t->watch), t->debounce_ms);
+}
+
+
+// Read the version & next id from the header line of the task file (0 if there's no header)
+static void read_header(FILE *txt, unsigned long *version, int *file_next_id) {
+    char header[128];
+    *version = 0;
+    *file_next_id = 1;
+
+    if (fgets(header, sizeof(header), txt) == NULL || header[0] != '#') {
+        // Older files have no header, start over from the first line
+        rewind(txt);
+        return;
+    }
+    sscanf(header, "#flux version=%lu next_id=%d", version, file_next_id);
+}
+
+
+// Save tasks to allow for persistent storage when user quits (write to the .txt file).
+// Returns SAVE_OK, SAVE_CONFLICT if another process saved since our load_tasks(), or SAVE_ERROR.
+int save_tasks() {
+    // Only one writer at a time, readers don't need the lock
+    int lock = store_lock();
+    if (lock < 0) {
+        perror("Failed to lock tasks file");
+        return SAVE_ERROR;
+    }
+
+    // Check nobody else saved since we loaded
+    unsigned long current_version = 0;
+    int file_next_id = 1;
+    FILE *current = fopen(TASK_FILE, "r");
+    if (current != NULL) {
+        read_header(current, &current_version, &file_next_id);
+        fclose(current);
+    }
+    if (current_version != loaded_version) {
+        store_unlock(lock);
+        return SAVE_CONFLICT;
+    }
+
+    // Write to a unique temp file so concurrent writers never share one
+    char temp_name[] = TASK_FILE ".XXXXXX";
+    int fd = mkstemp(temp_name);
+    FILE *txt = fd >= 0 ? fdopen(fd, "w") : NULL;
 
     // Check if the file opened successfully
     if (!txt) {
         fprintf(stderr, "Unable to save tasks to tasks.txt. Changes won't be saved.\n");
         perror("Failed to open tasks file");
-        return;
+        if (fd >= 0) {
+            close(fd);
+            unlink(temp_name);
+        }
+        store_unlock(lock);
+        return SAVE_ERROR;
     }
+    fchmod(fd, 0644);
+
+    // Header with the new version & the next id, so ids of deleted tasks aren't reused
+    fprintf(txt, "#flux version=%lu next_id=%d\n", current_version + 1, next_id);
 
     // Loop through task array
     for (int i = 0; i < task_count; i++) {
-        // Write all relevant task fields to file in single line using █ as delimiter
-        fprintf(txt, "%d█%s█%d█%ld█%d\n", tasks[i].id, tasks[i].command, tasks[i].interval_seconds, tasks[i].last_run, tasks[i].active);
+        // Write all relevant task fields to file in single line
+        write_task_line(txt, &tasks[i]);
     }
 
-    // Close the file
-    fclose(txt);
+    // Make sure the data is on disk before it replaces the old file
+    bool written = fflush(txt) == 0 && fsync(fd) == 0;
+    written = (fclose(txt) == 0) && written;
+    if (!written || rename(temp_name, TASK_FILE) != 0) {
+        perror("Failed to save tasks file");
+        unlink(temp_name);
+        store_unlock(lock);
+        return SAVE_ERROR;
+    }
+
+    loaded_version = current_version + 1;
+    store_unlock(lock);
+    return SAVE_OK;
 }
 
 
 // Loads tasks to allow them to be used when user returns (read the .txt file)
 void load_tasks() {
     // Buffer to store each line (max length of each line)
-    char buffer[1024]; 
+    char buffer[2048]; 
 
     // Open the file for reading and create a pointer to it
     FILE *txt = fopen(TASK_FILE, "r");
@@ -271,63 +1256,42 @@ void load_tasks() {
     // Clear current tasks in memory
     task_count = 0;
 
+    // Remember which version of the file we read (writers replace it with rename, so it can't change under us)
+    struct stat st;
+    if (fstat(fileno(txt), &st) == 0) {
+        loaded_identity = (FileIdentity){ st.st_dev, st.st_ino, st.st_size, st.st_mtime };
+    }
+    int file_next_id;
+    read_header(txt, &loaded_version, &file_next_id);
+    if (file_next_id > next_id) {
+        next_id = file_next_id;
+    }
+
     // Read line by line until end is reached & process the line stored in buffer
     while (fgets(buffer, sizeof(buffer), txt) != NULL) {
-        // Remove newline char
-        size_t len = strlen(buffer);
-        if (len > 0 && buffer[len - 1] == '\n') {
-            buffer[len - 1] = '\0';
-        }
-
-        // Parse fields by delimiter
-        char *token = strtok(buffer, DELIMITER);
-        if (token == NULL) continue;
-        // Set id
-        int id = atoi(token);
-
-        token = strtok(NULL, DELIMITER);
-        if (token == NULL) continue;
-        // Set command
-        char command[MAX_COMMAND_LEN];
-        strncpy(command, token, MAX_COMMAND_LEN - 1);
-        command[MAX_COMMAND_LEN - 1] = '\0';
-
-        token = strtok(NULL, DELIMITER);
-        if (token == NULL) continue;
-        // Set interval
-        int interval_seconds = atoi(token);
-
-        token = strtok(NULL, DELIMITER);
-        if (token == NULL) continue;
-        // Set last run
-        time_t last_run = (time_t)atol(token);
-
-        token = strtok(NULL, DELIMITER);
-        if (token == NULL) continue;
-        // Set active state
-        bool active = (atoi(token) != 0);
+        Task t;
+        if (parse_task_line(buffer, &t) != 0) continue;
 
         // Check if there is space for task
-        if (task_count >= MAX_TASKS) {
+        if (reserve_tasks(task_count + 1) != 0) {
             printf("Warning: Maximum task limit reached. Some tasks were not loaded.\n");
             break;
         }
 
         // Store task in array
-        tasks[task_count].id = id;
-        strncpy(tasks[task_count].command, command, MAX_COMMAND_LEN - 1);
-        tasks[task_count].command[MAX_COMMAND_LEN - 1] = '\0';
-        tasks[task_count].interval_seconds = interval_seconds;
-        tasks[task_count].last_run = last_run;
-        tasks[task_count].active = active;
-
+        tasks[task_count] = t;
         task_count++;
-
     }
+    index_dirty = true;
 
     // Close the file
     fclose(txt);
 
+    // Last run times are kept up to date by the scheduler in the state file
+    if (state_overlay(tasks, task_count) != 0) {
+        fprintf(stderr, "Warning: Couldn't read the latest run times, showing the ones saved in %s.\n", TASK_FILE);
+    }
+
     // After loading all tasks, update next_id to avoid ID conflicts
     for (int i = 0; i < task_count; i++) {
         if (tasks[i].id >= next_id) {
@@ -338,6 +1302,18 @@ void load_tasks() {
 
 }
 
+
+// Reload tasks only if another process replaced the task file, returns true if reloaded
+static bool reload_tasks() {
+    struct stat st;
+    if (stat(TASK_FILE, &st) == 0 && st.st_dev == loaded_identity.dev && st.st_ino == loaded_identity.ino &&
+        st.st_size == loaded_identity.size && st.st_mtime == loaded_identity.mtime) {
+        return false;
+    }
+    load_tasks();
+    return true;
+}
+
 // Check if a stop file exists
 bool file_exists(const char *filename) {
     FILE *file = fopen(filename, "r");
@@ -371,154 +1347,10 @@ bool command_exists(const char *command) {
     return (ret == 0);
 }
 
-// Update last_run property w/o rewriting whole task
-void update_last_run(int task_id, time_t new_last_run) {
-    // Open the original tasks file for reading
-    FILE *in = fopen(TASK_FILE, "r");
-    // Exit the func if file can't be opened
-    if (!in) return;
-
-    // Open a temp file for writing updated tasks
-    FILE *out = fopen("tasks_temp.txt", "w");
-    // Check if output file can't be opened
-    if (!out) {
-        // Close the file & exit the func
-        fclose(in);
-        return;
-    }
-
-    // Create a buffer to hold each line read
-    char buffer[1024];
-
-    // Read file line by line
-    while (fgets(buffer, sizeof(buffer), in)) {
-        // Skip blank lines
-        if (buffer[0] == '\n' || buffer[0] == '\0') {
-            continue;
-        }
-
-        // Make a working copy of line
-        char line[1024];
-        // Copy the buffer into the line
-        strncpy(line, buffer, sizeof(line) - 1);  
-        line[sizeof(line) - 1] = '\0';
-
-        // Array to store toekns from line
-        char *tokens[5];
-        // Index for token array
-        int i = 0;
-
-        // Tokenize line by the delimiter
-        char *token = strtok(line, "█");
-        while (token && i < 5) {
-            tokens[i++] = token;
-            token = strtok(NULL, "█");
-        }
-
-        // Check if line has exactly 5 tokens & if task ID matched
-        if (i == 5 && atoi(tokens[0]) == task_id) {
-            // Format buffer line w/ updated last_run time
-            snprintf(buffer, sizeof(buffer), "%s█%s█%s█%ld█%s\n",
-                    tokens[0], tokens[1], tokens[2],
-                    new_last_run, tokens[4]);
-        }
-
-        // Write the line if it has enough tokens
-        if (i >= 4) {
-            fputs(buffer, out);
-        }
-    }
-
-    // Close the input & output files
-    fclose(in);
-    fclose(out);
-
-    // Replace old file with updated temp file
-    rename("tasks_temp.txt", TASK_FILE);
-}
-
-
-// Display history from logs
-void display_history() {
-    // Open log file
-    FILE *txt = fopen(LOG_FILE, "r");
-
-    // If txt is NULL, it doesn't exist or can't be opened
-    if (!txt) {
-        printf("No history found. Failed to open log file.\n");
-        perror("System error");
-        return;
-    }
-
-    // Use a buffer
-    char line[1024];
-
-    // Track if file is empty
-    bool empty = true;
-
-    // Print header
-    printf("\n=== Task Run History ===\n\n");
-
-    // Read & print each line
-    while (fgets(line, sizeof(line), txt)) {
-        empty = false;
-        printf("%s", line);
-    }
-    
-    if (empty) {
-        printf("No task runs recorded yet.\n");
-    }
-
-    // Close file
-    fclose(txt);
-}
-
-
-// Display history from logs for specifc task id
-void display_history_filtered(int task_id) {
-    // Open log file
-    FILE *txt = fopen(LOG_FILE, "r");
-
-    // If txt is NULL, it doesn't exist or can't be opened
-    if (!txt) {
-        printf("No history found. Failed to open log file.\n");
-        perror("System error");
-        return;
-    }
-
-    // Use a buffer
-    char line[1024];
-
-    // Track if file is empty
-    bool empty = true;
-
-    // Print header
-    printf("\n=== Task Run History: ID = %d ===\n\n", task_id);
-
-    // Read & print each line
-    while (fgets(line, sizeof(line), txt)) {
-        char *pos = strstr(line, "Ran task #");
-        if (pos != NULL) {
-            // Move pointer to after "Ran task #"
-            pos += strlen("Ran task #");
-
-            // Parse integer task id from pos
-            int id_in_line = atoi(pos);
-
-            if (id_in_line == task_id) {
-                empty = false;
-                printf("%s", line);
-            }
-        }
-
-    }
-    
-    if (empty) {
-        printf("No task runs recorded yet.\n");
-    }
-
-    // Close file
-    fclose(txt);
+// Update last_run, last exit status & last skip w/o rewriting the task file. The values go to
+// the shared state file, which load_tasks() reads on top of tasks.txt.
+void update_last_run(const Task *t) {
+    state_write(t->id, t->last_run, t->last_status, t->skipped_at);
 }
 
 
@@ -585,14 +1417,32 @@ void print_usage() {
     printf("\nUsage: ./flux <command> [options]\n\n");
     printf("Available commands:\n");
     printf("  add \"<command>\" <interval>   Add a new task\n");
-    printf("  list                         List all tasks\n");
+    printf("  add ... --tags <a,b> --group <g>  Add a task with tags and/or a group\n");
+    printf("  add ... --cwd <dir> --env N=v --umask 022  Run a task in its own directory & environment\n");
+    printf("  add ... --priority critical|normal|low --deadline <s>  Set dispatch priority & deadline\n");
+    printf("  add ... --watch <path> --debounce <ms>  Also run when a file or directory changes\n");
+    printf("  list [options]               List tasks (see below)\n");
+    printf("  tag <id> <a,b> [group]       Set tags (and group) of a task\n");
     printf("  delete <id>                  Delete a task by ID\n");
-    printf("  pause <id>                   Pause a task\n");
-    printf("  resume <id>                  Resume a task\n");
+    printf("  run <id>                     Run a task right away (through the scheduler)\n");
+    printf("  pause <id>|--tag <tag>       Pause a task, or every task with a tag\n");
+    printf("  resume <id>|--tag <tag>      Resume a task, or every task with a tag\n");
     printf("  start                        Start the scheduler (run enabled tasks)\n");
     printf("  stop                         Stop the scheduler (stop all tasks)\n");
     printf("  status                       Show status of the scheduler\n");
-    printf("  history [id]                 Show run history (optionally filtered by ID)\n");
+    printf("  history [id] [--all]         Show run history (optionally filtered by ID, --all adds archives)\n");
+    printf("  history --report [id] [--all]  Show runs, failure rate & durations per task\n");
+    printf("  history --follow [id]        Print runs as they happen\n");
     printf("  archive                      Archive the log file\n");
+    printf("  trace --duration <seconds>   Record a Chrome/Perfetto trace of the scheduler\n");
     printf("  help                         Show this message\n\n");
+    printf("List options:\n");
+    printf("  --tag <tag> --group <group>  Only tasks with a tag / in a group\n");
+    printf("  --active | --paused          Only active or paused tasks\n");
+    printf("  --status ok|failed|never|<n> Filter by last exit status\n");
+    printf("  --due <seconds>              Only tasks due within the given time\n");
+    printf("  --grep <text>                Only tasks whose command contains text\n");
+    printf("  --sort id|next|last|status|interval [--desc]\n");
+    printf("  --limit <n> --offset <n>     Paginate the output\n");
+    printf("  --format box|compact|json    Output style (default box)\n\n");
 }
\ No newline at end of file
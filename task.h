@@ -1,7 +1,42 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <stdio.h>
 #include <time.h>
-#include <stdbool.h>  
+#include <stdbool.h>
+
+#define TASK_FILE "tasks.txt"
+#define LOG_FILE "task_logs.txt"
+#define ARCHIVE_DIR "archive"
 
 #define MAX_COMMAND_LEN 256
+#define MAX_TAGS_LEN 128
+#define MAX_GROUP_LEN 32
+#define MAX_PATH_LEN 256
+#define MAX_ENV_LEN 256
+
+// umask value meaning "use the scheduler's umask"
+#define UMASK_INHERIT -1
+// Passed to set_task_environment() to leave the umask as is
+#define UMASK_KEEP -2
+
+// Results of save_tasks()
+#define SAVE_OK 0
+#define SAVE_CONFLICT 1
+#define SAVE_ERROR -1
+
+// last_status value for tasks that haven't run yet
+#define STATUS_NONE -1
+
+// Quiet time after a change to a watched path before the task runs
+#define DEFAULT_DEBOUNCE_MS 200
+
+// Priority classes, lower values run first
+typedef enum {
+    PRIORITY_CRITICAL,
+    PRIORITY_NORMAL,
+    PRIORITY_LOW
+} Priority;
 
 // Task struct
 typedef struct {
@@ -9,14 +44,105 @@ typedef struct {
     char command[MAX_COMMAND_LEN];
     int interval_seconds;
     time_t last_run;
+    // When the scheduler last dropped a due run because the host was busy (0 = never).
+    // Kept apart from last_run so skips don't show up as runs, but it also pushes back next_due.
+    time_t skipped_at;
     bool active;
+    // Comma separated list of tags (ex. "etl,nightly")
+    char tags[MAX_TAGS_LEN];
+    // Single group name, empty if task isn't in a group
+    char group[MAX_GROUP_LEN];
+    // Exit status of the last run (STATUS_NONE if it hasn't run)
+    int last_status;
+    // Working directory, empty for the scheduler's own
+    char cwd[MAX_PATH_LEN];
+    // Environment overrides as NAME=value pairs separated by ';'
+    char env[MAX_ENV_LEN];
+    // File mode creation mask, UMASK_INHERIT to keep the scheduler's
+    int umask;
+    Priority priority;
+    // Seconds after becoming due the task should have started by (0 = one interval)
+    int deadline_seconds;
+    // File or directory whose changes run the task, empty if it only runs on its interval
+    char watch[MAX_PATH_LEN];
+    // Changes closer together than this are run once
+    int debounce_ms;
 } Task;
 
+// Which tasks to show based on their active state
+typedef enum {
+    STATE_ANY,
+    STATE_ACTIVE,
+    STATE_PAUSED
+} StateFilter;
+
+// Which tasks to show based on their last exit status
+typedef enum {
+    STATUS_ANY,
+    STATUS_OK,
+    STATUS_FAILED,
+    STATUS_NEVER,
+    STATUS_EXACT
+} StatusFilter;
+
+// Field used to order the task list
+typedef enum {
+    SORT_ID,
+    SORT_NEXT_DUE,
+    SORT_LAST_RUN,
+    SORT_STATUS,
+    SORT_INTERVAL
+} SortKey;
+
+// How the task list gets printed
+typedef enum {
+    FORMAT_BOX,
+    FORMAT_COMPACT,
+    FORMAT_JSON
+} ListFormat;
+
+// Filters, ordering & pagination for 'flux list'
+typedef struct {
+    const char *tag;
+    const char *group;
+    const char *grep;
+    StateFilter state;
+    StatusFilter status;
+    int status_code;
+    // Only tasks due within this many seconds (-1 = no filter)
+    int due_within;
+    SortKey sort;
+    bool descending;
+    int offset;
+    // Max tasks to show (0 = no limit)
+    int limit;
+} TaskQuery;
+
 // Function declarations (prototypes)
 int add_task(const char *command, int interval_seconds);
 
+int set_task_labels(int given_id, const char *tags, const char *group);
+
+int set_task_environment(int given_id, const char *cwd, const char *env, int mask);
+
+bool valid_env_entry(const char *entry);
+
+int set_task_priority(int given_id, Priority priority, int deadline_seconds);
+
+const char *priority_name(Priority priority);
+
+int parse_priority(const char *name, Priority *priority);
+
+int set_task_trigger(int given_id, const char *watch, int debounce_ms);
+
+bool task_exists(int given_id);
+
 void display_task();
 
+void init_query(TaskQuery *query);
+
+int list_tasks(const TaskQuery *query, ListFormat format);
+
 int scheduler();
 
 int delete_task(int given_id);
@@ -25,20 +151,31 @@ int pause_task(int given_id);
 
 int resume_task(int given_id);
 
-void save_tasks();
+int set_active_by_tag(const char *tag, bool active);
+
+bool valid_label(const char *label, bool allow_commas);
+
+bool valid_field(const char *value);
+
+bool valid_command(const char *command);
+
+int save_tasks();
 
 void load_tasks();
 
+// Read & write a single line of the task file (line is modified while parsing)
+int parse_task_line(char *line, Task *t);
+
+void write_task_line(FILE *txt, const Task *t);
+
 void print_usage();
 
 bool file_exists(const char *filename);
 
 bool command_exists(const char *command);
 
-void update_last_run(int task_id, time_t new_last_run);
-
-void display_history();
+void update_last_run(const Task *t);
 
-void display_history_filtered(int task_id);
+int archive_logs();
 
-int archive_logs();
\ No newline at end of file
+#endif
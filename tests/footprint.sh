@@ -0,0 +1,83 @@
+#!/bin/sh
+# Report binary size, startup time & steady-state memory of a flux build as key=value lines,
+# so they can be compared between builds & releases.
+#
+# Usage: tests/footprint.sh [flux binary]
+# Settings: TASKS (tasks loaded by the scheduler), RUNS (CLI starts timed), SETTLE (seconds before measuring)
+
+set -u
+
+FLUX=${1:-"$(cd "$(dirname "$0")/.." && pwd)/flux"}
+case $FLUX in
+    /*) ;;
+    *) FLUX="$(pwd)/$FLUX" ;;
+esac
+if [ ! -x "$FLUX" ]; then
+    echo "No flux binary at $FLUX" >&2
+    exit 1
+fi
+TASKS=${TASKS:-1000}
+RUNS=${RUNS:-200}
+SETTLE=${SETTLE:-5}
+
+dir=$(mktemp -d /tmp/flux-footprint.XXXXXX)
+cd "$dir" || exit 1
+
+now_us() {
+    echo $(($(date +%s%N) / 1000))
+}
+
+# Field of /proc/<pid>/status in kB
+status_kb() {
+    awk -v key="$2:" '$1 == key { print $2 }' "/proc/$1/status" 2>/dev/null
+}
+
+
+echo "binary_bytes=$(wc -c < "$FLUX")"
+if file "$FLUX" 2>/dev/null | grep -q "statically linked"; then
+    echo "linkage=static"
+else
+    echo "linkage=dynamic"
+fi
+
+for i in $(seq 1 "$TASKS"); do
+    "$FLUX" add "true" $((60 + i % 600)) --tags "t$((i % 10))"
+done > /dev/null 2>&1
+
+# CLI startup: exec, load the task file & print nothing interesting
+start=$(now_us)
+for i in $(seq 1 "$RUNS"); do
+    "$FLUX" help > /dev/null
+done
+echo "startup_help_us=$((($(now_us) - start) / RUNS))"
+
+start=$(now_us)
+for i in $(seq 1 "$RUNS"); do
+    "$FLUX" list --tag t3 --format compact --limit 1 > /dev/null
+done
+echo "startup_list_us=$((($(now_us) - start) / RUNS))"
+
+# Scheduler startup: from 'flux start' until it's looping (flag file created)
+start=$(now_us)
+# Output goes to a file, the scheduler would keep a pipe open
+"$FLUX" start > start.out 2>&1
+pid=$(sed -n 's/.*(PID \([0-9]*\)).*/\1/p' start.out)
+while [ ! -f scheduler.running ]; do
+    sleep 0.001
+done
+echo "startup_scheduler_us=$(($(now_us) - start))"
+
+# Steady state once the first runs of all tasks are done
+sleep "$SETTLE"
+launcher=$(pgrep -P "$pid" | head -n 1)
+if [ -r "/proc/$pid/status" ]; then
+    echo "scheduler_rss_kb=$(status_kb "$pid" VmRSS)"
+    echo "scheduler_peak_rss_kb=$(status_kb "$pid" VmHWM)"
+    echo "launcher_rss_kb=$(status_kb "$launcher" VmRSS)"
+else
+    echo "scheduler_rss_kb=unknown"
+fi
+
+"$FLUX" stop > /dev/null
+sleep 1
+cd / && rm -rf "$dir"
@@ -0,0 +1,30 @@
+#include "history.h"
+#include "task.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Fuzz target for the log line parser. The line is copied into a buffer of exactly its size,
+// so reading past the end shows up under ASan.
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    char *line = malloc(size > 0 ? size : 1);
+    if (line == NULL) {
+        return 0;
+    }
+    memcpy(line, data, size);
+
+    LogRecord record;
+    if (parse_log_line(line, size, &record) == 0) {
+        // The command must be the tail of the line
+        if (record.command < line || record.command + record.command_len != line + size) {
+            abort();
+        }
+        if (record.task_id < 0 || record.hour < 0 || (record.status != STATUS_NONE && record.status < 0) || record.duration_ms < -1) {
+            abort();
+        }
+    }
+
+    free(line);
+    return 0;
+}
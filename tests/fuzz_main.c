@@ -0,0 +1,121 @@
+// Driver for the fuzz targets when libFuzzer isn't used (gcc builds, AFL).
+// Runs every file given on the command line, or stdin without arguments. With
+// -mutate <n> it also runs n random mutations of the given files.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_INPUT 65536
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+
+// Read a whole file (or stdin for NULL), returns its size or -1
+static long read_input(const char *filename, uint8_t *data) {
+    FILE *file = filename ? fopen(filename, "rb") : stdin;
+    if (file == NULL) {
+        perror(filename);
+        return -1;
+    }
+    size_t size = fread(data, 1, MAX_INPUT, file);
+    if (filename) {
+        fclose(file);
+    }
+    return (long)size;
+}
+
+
+// Change an input a little: flip, insert, delete or duplicate bytes, or insert the task delimiter
+static size_t mutate(uint8_t *data, size_t size) {
+    static const char *tokens[] = { "█", "\n", "\xe2", "\xe2\x96", "-", "9999999999", " (exit ", " ms): ", "#" };
+    int edits = 1 + rand() % 4;
+
+    for (int e = 0; e < edits; e++) {
+        size_t pos = size > 0 ? (size_t)rand() % (size + 1) : 0;
+        switch (rand() % 5) {
+            case 0:
+                if (pos < size) {
+                    data[pos] ^= (uint8_t)(1u << (rand() % 8));
+                }
+                break;
+            case 1:
+                if (size < MAX_INPUT) {
+                    memmove(data + pos + 1, data + pos, size - pos);
+                    data[pos] = (uint8_t)rand();
+                    size++;
+                }
+                break;
+            case 2:
+                if (pos < size) {
+                    memmove(data + pos, data + pos + 1, size - pos - 1);
+                    size--;
+                }
+                break;
+            case 3: {
+                const char *token = tokens[rand() % (sizeof(tokens) / sizeof(tokens[0]))];
+                size_t len = strlen(token);
+                if (size + len <= MAX_INPUT) {
+                    memmove(data + pos + len, data + pos, size - pos);
+                    memcpy(data + pos, token, len);
+                    size += len;
+                }
+                break;
+            }
+            default:
+                // Cut the input short
+                size = pos;
+        }
+    }
+    return size;
+}
+
+
+int main(int argc, char *argv[]) {
+    static uint8_t input[MAX_INPUT];
+    static uint8_t work[MAX_INPUT];
+    long mutations = 0;
+    int first_file = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-mutate") == 0) {
+        mutations = atol(argv[2]);
+        first_file = 3;
+    }
+
+    // Repeatable runs, FUZZ_SEED picks another sequence
+    const char *seed = getenv("FUZZ_SEED");
+    srand(seed ? (unsigned)atoi(seed) : 1);
+
+    if (first_file >= argc) {
+        long size = read_input(NULL, input);
+        if (size < 0) {
+            return 1;
+        }
+        LLVMFuzzerTestOneInput(input, (size_t)size);
+        return 0;
+    }
+
+    int inputs = argc - first_file;
+    for (int i = first_file; i < argc; i++) {
+        long size = read_input(argv[i], input);
+        if (size < 0) {
+            return 1;
+        }
+        LLVMFuzzerTestOneInput(input, (size_t)size);
+
+        // Spread the mutations over the inputs
+        for (long m = 0; m < mutations / inputs; m++) {
+            memcpy(work, input, (size_t)size);
+            size_t mutated = (size_t)size;
+            // Stack a few rounds so mutations build on each other
+            for (int round = 0; round < 1 + m % 4; round++) {
+                mutated = mutate(work, mutated);
+            }
+            LLVMFuzzerTestOneInput(work, mutated);
+        }
+    }
+
+    printf("%s: %d input(s), %ld mutation(s) ok\n", argv[0], inputs, mutations - mutations % inputs);
+    return 0;
+}
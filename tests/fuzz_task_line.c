@@ -0,0 +1,50 @@
+#include "task.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Check two parsed tasks hold the same values
+static void check_same(const Task *a, const Task *b) {
+    if (a->id != b->id || strcmp(a->command, b->command) != 0 || a->interval_seconds != b->interval_seconds ||
+        a->last_run != b->last_run || a->active != b->active || strcmp(a->tags, b->tags) != 0 ||
+        strcmp(a->group, b->group) != 0 || a->last_status != b->last_status || strcmp(a->cwd, b->cwd) != 0 ||
+        strcmp(a->env, b->env) != 0 || a->umask != b->umask || a->priority != b->priority ||
+        a->deadline_seconds != b->deadline_seconds || strcmp(a->watch, b->watch) != 0 ||
+        a->debounce_ms != b->debounce_ms) {
+        abort();
+    }
+}
+
+
+// Fuzz target for the task file parser: any line that parses must be written back as a line
+// that parses to the same task
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    char *line = malloc(size + 1);
+    if (line == NULL) {
+        return 0;
+    }
+    memcpy(line, data, size);
+    line[size] = '\0';
+
+    Task first;
+    if (parse_task_line(line, &first) == 0) {
+        char *written = NULL;
+        size_t written_len = 0;
+        FILE *txt = open_memstream(&written, &written_len);
+        if (txt != NULL) {
+            write_task_line(txt, &first);
+            fclose(txt);
+
+            Task second;
+            if (parse_task_line(written, &second) != 0) {
+                abort();
+            }
+            check_same(&first, &second);
+            free(written);
+        }
+    }
+
+    free(line);
+    return 0;
+}
@@ -0,0 +1,135 @@
+#!/bin/sh
+# Stress test: CLI processes add, pause & delete tasks while the scheduler runs thousands of others.
+# Checks that no edit gets lost, no task runs twice in one interval and runs don't lag behind.
+#
+# Usage: tests/stress.sh [seconds]
+# Settings: WORKERS (CLI processes), STEADY (interval tasks), MAX_ADDS (per worker), LAG_LIMIT (seconds)
+
+set -u
+
+FLUX="$(cd "$(dirname "$0")/.." && pwd)/flux"
+DURATION=${1:-30}
+WORKERS=${WORKERS:-8}
+STEADY=${STEADY:-100}
+MAX_ADDS=${MAX_ADDS:-150}
+LAG_LIMIT=${LAG_LIMIT:-3}
+
+dir=$(mktemp -d /tmp/flux-stress.XXXXXX)
+cd "$dir" || exit 1
+echo "Stress test in $dir for ${DURATION}s ($WORKERS workers, $STEADY steady tasks)"
+
+# Sanitizer builds write their reports here instead of to the scheduler's terminal
+export ASAN_OPTIONS="log_path=$dir/sanitizer:detect_leaks=0"
+export UBSAN_OPTIONS="log_path=$dir/sanitizer:print_stacktrace=1"
+export TSAN_OPTIONS="log_path=$dir/sanitizer"
+
+failures=0
+fail() {
+    echo "FAIL: $*"
+    failures=$((failures + 1))
+}
+
+
+# Interval tasks nobody touches, their runs are checked for timing. Critical so load shedding leaves them alone.
+for i in $(seq 1 "$STEADY"); do
+    "$FLUX" add "true" $((1 + i % 2)) --tags steady --priority critical > /dev/null 2>&1 || fail "adding steady task $i"
+done
+
+"$FLUX" start > scheduler.out 2>&1 || fail "starting scheduler"
+sleep 1
+# Only one scheduler may run
+"$FLUX" start 2>&1 | grep -q "already running" || fail "second scheduler was started"
+
+end=$(($(date +%s) + DURATION))
+
+
+# Add tasks, then pause, resume or delete some of them. Every change that reports success goes
+# into expected.<worker> so it can be compared with the task file at the end.
+worker() {
+    w=$1
+    adds=0
+    : > "expected.$w"
+    while [ "$(date +%s)" -lt "$end" ] && [ "$adds" -lt "$MAX_ADDS" ]; do
+        out=$("$FLUX" add "true" 3600 --tags "w$w")
+        id=$(printf '%s\n' "$out" | sed -n 's/.*with ID of \([0-9]*\) has been added.*/\1/p')
+        if [ -z "$id" ]; then
+            echo "worker $w: add failed: $out" >> errors
+            continue
+        fi
+        adds=$((adds + 1))
+        echo "$id active" >> "expected.$w"
+
+        case $((id % 4)) in
+            0) "$FLUX" pause "$id" > /dev/null && echo "$id paused" >> "expected.$w" ;;
+            1) "$FLUX" delete "$id" > /dev/null && echo "$id deleted" >> "expected.$w" ;;
+            2) "$FLUX" pause "$id" > /dev/null && "$FLUX" resume "$id" > /dev/null && echo "$id active" >> "expected.$w" ;;
+        esac
+    done
+}
+
+for w in $(seq 1 "$WORKERS"); do
+    worker "$w" &
+done
+wait
+
+# Let the scheduler catch up on the last additions, then stop it
+sleep 3
+[ -f scheduler.running ] || fail "scheduler stopped during the test"
+"$FLUX" stop > /dev/null
+sleep 2
+
+
+# No lost updates: the final state of each task is the last one its worker saw succeed
+[ -f errors ] && fail "$(wc -l < errors) CLI edits failed (see $dir/errors)"
+for w in $(seq 1 "$WORKERS"); do
+    awk '{ state[$1] = $2 } END { for (id in state) if (state[id] != "deleted") print id, state[id] }' "expected.$w" | sort -n > "want.$w"
+    "$FLUX" list --tag "w$w" --format compact | awk '$1 ~ /^[0-9]+$/ { print $1, $2 }' | sort -n > "have.$w"
+    if ! cmp -s "want.$w" "have.$w"; then
+        fail "worker $w: task file doesn't match its edits (see $dir/want.$w & have.$w)"
+    fi
+done
+
+# Runs per task, with the gap between consecutive runs (log times have one second resolution)
+awk '/ Ran task #/ {
+        split($2, t, /[:\]]/)
+        seconds = t[1] * 3600 + t[2] * 60 + t[3]
+        id = $5; sub(/^#/, "", id)
+        if (id in last) print id, seconds - last[id]
+        last[id] = seconds
+        runs++
+     }
+     END { print "total", runs }' task_logs.txt > gaps.txt
+
+runs=$(awk '$1 == "total" { print $2 }' gaps.txt)
+echo "Scheduler ran ${runs:-0} tasks"
+[ "${runs:-0}" -gt 0 ] || fail "no task ran"
+
+# No double fires & bounded lag for steady tasks (interval 1 or 2). Worker tasks run once at most.
+awk -v steady="$STEADY" -v lag="$LAG_LIMIT" '
+    $1 == "total" { next }
+    $1 <= steady {
+        interval = 1 + $1 % 2
+        if ($2 < interval) early++
+        if ($2 > interval + lag) late++
+        if ($2 > worst) worst = $2
+        next
+    }
+    { repeated++ }
+    END { printf "%d %d %d %d\n", early, late, repeated, worst }' gaps.txt > timing.txt
+read -r early late repeated worst < timing.txt
+echo "Steady tasks: longest gap ${worst}s"
+[ "$early" -eq 0 ] || fail "$early runs started before their interval passed (double fire)"
+[ "$late" -eq 0 ] || fail "$late runs lagged more than ${LAG_LIMIT}s behind their interval"
+[ "$repeated" -eq 0 ] || fail "$repeated worker tasks ran more than once"
+
+if ls "$dir"/sanitizer* > /dev/null 2>&1; then
+    fail "sanitizer reports in $dir"
+fi
+
+if [ "$failures" -eq 0 ]; then
+    echo "Stress test passed"
+    rm -rf "$dir"
+    exit 0
+fi
+echo "Stress test failed, files kept in $dir"
+exit 1
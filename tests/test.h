@@ -0,0 +1,101 @@
+#ifndef TEST_H
+#define TEST_H
+
+// Minimal test helpers: CHECK macros count failures, test_finish() prints the result
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int test_checks = 0;
+static int test_failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        test_checks++; \
+        if (!(cond)) { \
+            test_failures++; \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+#define CHECK_INT(actual, expected) \
+    do { \
+        long long actual_ = (long long)(actual); \
+        long long expected_ = (long long)(expected); \
+        test_checks++; \
+        if (actual_ != expected_) { \
+            test_failures++; \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, actual_, expected_); \
+        } \
+    } while (0)
+
+#define CHECK_STR(actual, expected) \
+    do { \
+        const char *actual_ = (actual); \
+        const char *expected_ = (expected); \
+        test_checks++; \
+        if (strcmp(actual_, expected_) != 0) { \
+            test_failures++; \
+            fprintf(stderr, "%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual, actual_, expected_); \
+        } \
+    } while (0)
+
+
+// Temporary directory of this test & the process that made it (forked children leave it alone)
+static char test_dir[] = "/tmp/flux-test.XXXXXX";
+static pid_t test_dir_owner = 0;
+
+
+// Delete a directory & everything in it
+static inline void test_remove_tree(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            char child[512];
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            struct stat st;
+            if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+                test_remove_tree(child);
+            } else {
+                unlink(child);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+
+static inline void test_leave_tempdir() {
+    if (getpid() == test_dir_owner) {
+        test_remove_tree(test_dir);
+    }
+}
+
+
+// Run from a fresh temporary directory so tests never touch real task files, removed on exit
+static inline void test_enter_tempdir() {
+    if (mkdtemp(test_dir) == NULL || chdir(test_dir) != 0) {
+        perror("Failed to create test directory");
+        exit(2);
+    }
+    test_dir_owner = getpid();
+    atexit(test_leave_tempdir);
+}
+
+
+// Print a summary, returns the exit code for main()
+static inline int test_finish(const char *name) {
+    printf("%-14s %4d checks, %d failed\n", name, test_checks, test_failures);
+    return test_failures == 0 ? 0 : 1;
+}
+
+#endif
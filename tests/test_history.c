@@ -0,0 +1,176 @@
+#include "test.h"
+#include "history.h"
+#include "task.h"
+
+
+static int parse(const char *line, LogRecord *record) {
+    return parse_log_line(line, strlen(line), record);
+}
+
+
+static void test_current_format() {
+    LogRecord record;
+    const char *line = "[2024-03-05 14:07:09] Ran task #12 (exit 3, 250 ms): echo hi: there";
+    CHECK_INT(parse(line, &record), 0);
+    CHECK_INT(record.task_id, 12);
+    CHECK_INT(record.status, 3);
+    CHECK_INT(record.duration_ms, 250);
+    CHECK_INT(record.command_len, strlen("echo hi: there"));
+    CHECK(memcmp(record.command, "echo hi: there", record.command_len) == 0);
+
+    // Hours since the epoch of the (local) timestamp
+    LogRecord next;
+    CHECK_INT(parse("[2024-03-06 15:00:00] Ran task #1 (exit 0, 0 ms): x", &next), 0);
+    CHECK_INT(next.hour - record.hour, 25);
+    CHECK_INT(parse("[1970-01-01 00:00:00] Ran task #1 (exit 0, 0 ms): x", &next), 0);
+    CHECK_INT(next.hour, 0);
+}
+
+
+static void test_old_format() {
+    LogRecord record;
+    CHECK_INT(parse("[2023-12-31 23:59:59] Ran task #4: ls", &record), 0);
+    CHECK_INT(record.task_id, 4);
+    CHECK_INT(record.status, STATUS_NONE);
+    CHECK_INT(record.duration_ms, -1);
+    CHECK_INT(record.command_len, 2);
+}
+
+
+static void test_rejected_lines() {
+    LogRecord record;
+    CHECK_INT(parse("", &record), -1);
+    CHECK_INT(parse("[2024-03-05 14:07:09] Skipped task #3 (host busy): ls", &record), -1);
+    CHECK_INT(parse("[2024-13-05 14:07:09] Ran task #3: ls", &record), -1);
+    CHECK_INT(parse("[2024-03-05 24:07:09] Ran task #3: ls", &record), -1);
+    CHECK_INT(parse("[1969-12-31 23:00:00] Ran task #1 (exit 0, 5 ms): echo hi", &record), -1);
+    CHECK_INT(parse("[0000-01-01 00:00:00] Ran task #1: ls", &record), -1);
+    CHECK_INT(parse("[2024-03-05 14:07:09] Ran task #: ls", &record), -1);
+    CHECK_INT(parse("[2024-03-05 14:07:09] Ran task #3 (exit x, 1 ms): ls", &record), -1);
+    CHECK_INT(parse("[2024-03-05 14:07:09] Ran task #3 (exit 0, 1 ms) ls", &record), -1);
+    CHECK_INT(parse("[2024-03-05 14:07:09] Ran task #99999999999999999999: ls", &record), -1);
+
+    // Every cut of a valid line is rejected until the command starts, reading past the end would show under ASan
+    const char *line = "[2024-03-05 14:07:09] Ran task #12 (exit 3, 250 ms): ";
+    size_t full = strlen(line);
+    for (size_t len = 0; len < full; len++) {
+        char *copy = malloc(len + 1);
+        memcpy(copy, line, len);
+        copy[len] = '\0';
+        CHECK_INT(parse_log_line(copy, len, &record), -1);
+        free(copy);
+    }
+    CHECK_INT(parse(line, &record), 0);
+    CHECK_INT(record.command_len, 0);
+}
+
+
+// Write a log file, run the report over it & return its output (static buffer)
+static const char *report(const char *log, int *result) {
+    static char output[8192];
+    FILE *file = fopen(LOG_FILE, "w");
+    fputs(log, file);
+    fclose(file);
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    FILE *capture = freopen("report.out", "w", stdout);
+    *result = history_report(0, false);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    (void)capture;
+
+    file = fopen("report.out", "r");
+    size_t size = fread(output, 1, sizeof(output) - 1, file);
+    output[size] = '\0';
+    fclose(file);
+    return output;
+}
+
+
+static void test_report() {
+    int result;
+    // Lines from before 1970 are skipped instead of landing at a negative hour of day
+    const char *output = report("[1969-12-31 23:00:00] Ran task #1 (exit 0, 5 ms): echo hi\n"
+                                "[2024-03-05 14:07:09] Ran task #2 (exit 1, 40 ms): false\n", &result);
+    CHECK_INT(result, 0);
+    CHECK(strstr(output, "Runs:      1 over 1 hour") != NULL);
+    CHECK(strstr(output, "  14:00 ######################################## 1") != NULL);
+    CHECK(strstr(output, "echo hi") == NULL);
+}
+
+
+static void test_report_out_of_order() {
+    int result;
+    // A long run started at 13:50 is logged after shorter runs of 14:00
+    const char *output = report("[2024-03-05 13:10:00] Ran task #1 (exit 0, 5 ms): a\n"
+                                "[2024-03-05 14:00:00] Ran task #1 (exit 0, 5 ms): a\n"
+                                "[2024-03-05 13:50:00] Ran task #2 (exit 0, 1800000 ms): b\n"
+                                "[2024-03-05 14:10:00] Ran task #1 (exit 0, 5 ms): a\n"
+                                "[2024-03-05 14:20:00] Ran task #1 (exit 0, 5 ms): a\n", &result);
+    CHECK_INT(result, 0);
+    CHECK(strstr(output, "Runs:      5 over 2 hours") != NULL);
+    CHECK(strstr(output, "peak 3 at 2024-03-05 14:00") != NULL);
+}
+
+
+static void test_report_large_ids() {
+    int result;
+    // Rows are sorted by id, however far apart the ids are
+    const char *output = report("[2024-03-05 14:00:00] Ran task #1500000000 (exit 0, 5 ms): big\n"
+                                "[2024-03-05 14:00:01] Ran task #2147483647 (exit 0, 5 ms): max\n"
+                                "[2024-03-05 14:00:02] Ran task #0 (exit 0, 5 ms): zero\n"
+                                "[2024-03-05 14:00:03] Ran task #1500000000 (exit 1, 7 ms): big\n", &result);
+    CHECK_INT(result, 0);
+    const char *zero = strstr(output, "\n0 ");
+    const char *big = strstr(output, "\n1500000000        2 ");
+    const char *max = strstr(output, "\n2147483647        1 ");
+    CHECK(zero != NULL && big != NULL && max != NULL);
+    CHECK(zero < big && big < max);
+
+    // Enough sparse ids to grow the table several times
+    size_t size = 5000 * 64;
+    char *log = malloc(size);
+    size_t used = 0;
+    for (int i = 0; i < 5000; i++) {
+        used += (size_t)snprintf(log + used, size - used, "[2024-03-05 14:00:00] Ran task #%d (exit 0, 1 ms): t\n",
+                                 0x7fffffff - i * 409573);
+    }
+    output = report(log, &result);
+    CHECK_INT(result, 0);
+    CHECK(strstr(output, "Runs:      5000 over 1 hour") != NULL);
+    free(log);
+}
+
+
+static void test_report_percentiles() {
+    int result;
+    // Percentiles never fall outside the durations seen, even when they share a bucket
+    const char *output = report("[2024-03-05 14:00:00] Ran task #1 (exit 0, 3001 ms): a\n"
+                                "[2024-03-05 14:00:01] Ran task #1 (exit 0, 3001 ms): a\n"
+                                "[2024-03-05 14:00:02] Ran task #2 (exit 0, 3001 ms): b\n"
+                                "[2024-03-05 14:00:03] Ran task #2 (exit 0, 3020 ms): b\n"
+                                "[2024-03-05 14:00:04] Ran task #3 (exit 0, 1000 ms): c\n"
+                                "[2024-03-05 14:00:05] Ran task #3 (exit 0, 2000 ms): c\n"
+                                "[2024-03-05 14:00:06] Ran task #3 (exit 0, 3000 ms): c\n", &result);
+    CHECK_INT(result, 0);
+    CHECK(strstr(output, "\n1             2     0.0     3001     3001     3001     3001  a") != NULL);
+    CHECK(strstr(output, "\n2             2     0.0     3001     3020     3020     3020  b") != NULL);
+    // Midpoints stay within the ~1.6% bucket error of the exact ranks
+    CHECK(strstr(output, "\n3             3     0.0     2007     2991     2991     3000  c") != NULL);
+}
+
+
+int main() {
+    test_current_format();
+    test_old_format();
+    test_rejected_lines();
+
+    test_enter_tempdir();
+    test_report();
+    test_report_out_of_order();
+    test_report_large_ids();
+    test_report_percentiles();
+    return test_finish("test_history");
+}
@@ -0,0 +1,142 @@
+#include "test.h"
+#include "index.h"
+
+
+#define TASK_COUNT 6
+
+static Task tasks[TASK_COUNT];
+static int out[TASK_COUNT];
+
+
+static void make_task(int position, int id, const char *tags, const char *group, bool active, int status,
+                      time_t last_run, int interval) {
+    Task *t = &tasks[position];
+    memset(t, 0, sizeof(*t));
+    t->id = id;
+    snprintf(t->command, sizeof(t->command), "echo task%d", id);
+    strcpy(t->tags, tags);
+    strcpy(t->group, group);
+    t->active = active;
+    t->last_status = status;
+    t->last_run = last_run;
+    t->interval_seconds = interval;
+}
+
+
+// Ids of the matched tasks joined with ',' (in result order)
+static const char *query_ids(const TaskQuery *query) {
+    static char ids[128];
+    int count = index_query(query, 1000, out);
+    ids[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        snprintf(ids + strlen(ids), sizeof(ids) - strlen(ids), i ? ",%d" : "%d", tasks[out[i]].id);
+    }
+    return ids;
+}
+
+
+static void test_filters() {
+    TaskQuery query;
+
+    init_query(&query);
+    CHECK_STR(query_ids(&query), "1,2,3,4,5,6");
+
+    init_query(&query);
+    query.tag = "etl";
+    CHECK_STR(query_ids(&query), "1,2,5");
+    // Tags match whole labels only
+    query.tag = "et";
+    CHECK_STR(query_ids(&query), "");
+
+    init_query(&query);
+    query.group = "data";
+    query.state = STATE_ACTIVE;
+    CHECK_STR(query_ids(&query), "1,3");
+
+    init_query(&query);
+    query.status = STATUS_FAILED;
+    CHECK_STR(query_ids(&query), "2,5");
+    query.status = STATUS_NEVER;
+    CHECK_STR(query_ids(&query), "6");
+    query.status = STATUS_EXACT;
+    query.status_code = 0;
+    CHECK_STR(query_ids(&query), "1,3,4");
+
+    // Due within 60s of now (1000), never run counts as due, triggered-only tasks never are
+    init_query(&query);
+    query.due_within = 60;
+    CHECK_STR(query_ids(&query), "1,3,6");
+
+    init_query(&query);
+    query.grep = "task5";
+    CHECK_STR(query_ids(&query), "5");
+
+    init_query(&query);
+    query.tag = "etl";
+    query.group = "missing";
+    CHECK_STR(query_ids(&query), "");
+    // A label index that matched nothing isn't replaced by a later, bigger one
+    init_query(&query);
+    query.tag = "missing";
+    query.group = "data";
+    query.state = STATE_ACTIVE;
+    CHECK_STR(query_ids(&query), "");
+}
+
+
+static void test_sorting() {
+    TaskQuery query;
+    init_query(&query);
+    query.sort = SORT_INTERVAL;
+    CHECK_STR(query_ids(&query), "5,2,1,3,6,4");
+    query.descending = true;
+    CHECK_STR(query_ids(&query), "4,6,3,1,2,5");
+
+    init_query(&query);
+    query.sort = SORT_STATUS;
+    CHECK_STR(query_ids(&query), "6,1,3,4,2,5");
+}
+
+
+static void test_skipped_runs() {
+    Task t;
+    memset(&t, 0, sizeof(t));
+    t.interval_seconds = 60;
+    t.last_run = 900;
+    CHECK_INT(next_due(&t), 960);
+    // A skip pushes the next run back without counting as a run
+    t.skipped_at = 950;
+    CHECK_INT(next_due(&t), 1010);
+    t.last_run = 0;
+    CHECK_INT(next_due(&t), 1010);
+}
+
+
+static void test_labels() {
+    const int *positions;
+    CHECK_INT(index_lookup_tag("nightly", &positions), 2);
+    CHECK_INT(index_lookup_tag("nothing", &positions), 0);
+    CHECK(has_label("a,bb,c", "bb"));
+    CHECK(!has_label("a,bb,c", "b"));
+    CHECK(!has_label("", "a"));
+}
+
+
+int main() {
+    make_task(0, 1, "etl,nightly", "data", true, 0, 950, 30);
+    make_task(1, 2, "etl", "data", false, 1, 900, 10);
+    make_task(2, 3, "nightly", "data", true, 0, 920, 60);
+    make_task(3, 4, "", "", true, 0, 990, 3600);
+    make_task(4, 5, "etl", "ops", true, 2, 0, 0);
+    make_task(5, 6, "", "ops", true, STATUS_NONE, 0, 120);
+    // Triggered-only task that already ran
+    tasks[4].last_run = 995;
+
+    index_build(tasks, TASK_COUNT);
+    test_filters();
+    test_sorting();
+    test_labels();
+    test_skipped_runs();
+    index_free();
+    return test_finish("test_index");
+}
@@ -0,0 +1,145 @@
+#include "test.h"
+#include "store.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+
+
+static void test_locks() {
+    int fd = store_lock();
+    CHECK(fd >= 0);
+    // Nested calls share the lock instead of waiting on themselves
+    CHECK_INT(store_lock(), fd);
+    store_unlock(fd);
+
+    // Still held by the outer call: another process can't take it
+    pid_t pid = fork();
+    if (pid == 0) {
+        int probe = open(LOCK_FILE, O_RDWR);
+        _exit(flock(probe, LOCK_EX | LOCK_NB) == 0 ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    CHECK_INT(WEXITSTATUS(status), 1);
+
+    store_unlock(fd);
+    pid = fork();
+    if (pid == 0) {
+        int probe = open(LOCK_FILE, O_RDWR);
+        _exit(flock(probe, LOCK_EX | LOCK_NB) == 0 ? 0 : 1);
+    }
+    waitpid(pid, &status, 0);
+    CHECK_INT(WEXITSTATUS(status), 0);
+
+    // Only one scheduler: a second process can't claim the daemon lock
+    CHECK(store_claim_daemon() >= 0);
+    pid = fork();
+    if (pid == 0) {
+        int probe = open(DAEMON_LOCK_FILE, O_RDWR);
+        _exit(flock(probe, LOCK_EX | LOCK_NB) == 0 ? 0 : 1);
+    }
+    waitpid(pid, &status, 0);
+    CHECK_INT(WEXITSTATUS(status), 1);
+}
+
+
+static void test_state() {
+    CHECK_INT(state_open(true), 0);
+
+    Task tasks[3];
+    memset(tasks, 0, sizeof(tasks));
+    for (int i = 0; i < 3; i++) {
+        tasks[i].id = i + 1;
+        tasks[i].last_status = STATUS_NONE;
+    }
+    // Task file newer than the state file wins
+    tasks[2].last_run = 5000;
+
+    state_write(1, 1000, 0, 0);
+    state_write(2, 2000, 7, 0);
+    state_write(2, 2500, 1, 0);
+    state_write(3, 4000, 2, 0);
+    CHECK_INT(state_overlay(tasks, 3), 0);
+    CHECK_INT(tasks[0].last_run, 1000);
+    CHECK_INT(tasks[0].last_status, 0);
+    CHECK_INT(tasks[1].last_run, 2500);
+    CHECK_INT(tasks[1].last_status, 1);
+    CHECK_INT(tasks[1].skipped_at, 0);
+    CHECK_INT(tasks[2].last_run, 5000);
+    CHECK_INT(tasks[2].last_status, STATUS_NONE);
+
+    // Writes show up in other processes that map the file
+    pid_t pid = fork();
+    if (pid == 0) {
+        Task t;
+        memset(&t, 0, sizeof(t));
+        t.id = 2;
+        state_overlay(&t, 1);
+        _exit(t.last_run == 2500 ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    CHECK_INT(WEXITSTATUS(status), 0);
+
+    // Pruning keeps the entries of tasks that still exist
+    for (int id = 100; id < 100 + 20000; id++) {
+        state_write(id, id, 0, 0);
+    }
+    state_prune(tasks, 2);
+    Task again[3];
+    memcpy(again, tasks, sizeof(again));
+    again[0].last_run = 0;
+    again[2].last_run = 0;
+    state_overlay(again, 3);
+    CHECK_INT(again[0].last_run, 1000);
+    CHECK_INT(again[2].last_run, 0);
+    Task gone;
+    memset(&gone, 0, sizeof(gone));
+    gone.id = 150;
+    state_overlay(&gone, 1);
+    CHECK_INT(gone.last_run, 0);
+
+    // Skips come back without touching the last run
+    Task skipped;
+    memset(&skipped, 0, sizeof(skipped));
+    skipped.id = 4;
+    skipped.last_status = STATUS_NONE;
+    state_write(4, 0, STATUS_NONE, 3000);
+    state_overlay(&skipped, 1);
+    CHECK_INT(skipped.last_run, 0);
+    CHECK_INT(skipped.last_status, STATUS_NONE);
+    CHECK_INT(skipped.skipped_at, 3000);
+
+    // A scheduler that stays mid-write (odd seq, after magic & slot count) never gives a
+    // consistent copy: the overlay fails & leaves the task file's values alone
+    int fd = open(STATE_FILE, O_RDWR);
+    uint64_t seq = 0;
+    CHECK_INT(pread(fd, &seq, sizeof(seq), 8), sizeof(seq));
+    uint64_t writing = seq + 1;
+    CHECK_INT(pwrite(fd, &writing, sizeof(writing), 8), sizeof(writing));
+    Task stale;
+    memset(&stale, 0, sizeof(stale));
+    stale.id = 4;
+    stale.last_run = 100;
+    stale.last_status = 0;
+    CHECK_INT(state_overlay(&stale, 1), -1);
+    CHECK_INT(stale.last_run, 100);
+    CHECK_INT(stale.last_status, 0);
+    CHECK_INT(stale.skipped_at, 0);
+
+    uint64_t done = seq + 2;
+    CHECK_INT(pwrite(fd, &done, sizeof(done), 8), sizeof(done));
+    close(fd);
+    stale.last_run = 0;
+    CHECK_INT(state_overlay(&stale, 1), 0);
+    CHECK_INT(stale.skipped_at, 3000);
+}
+
+
+int main() {
+    test_enter_tempdir();
+    test_locks();
+    test_state();
+    return test_finish("test_store");
+}
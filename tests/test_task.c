@@ -0,0 +1,272 @@
+#include "test.h"
+#include "task.h"
+
+
+// Write a task with write_task_line() & parse it back
+static int roundtrip(const Task *in, Task *out) {
+    char line[4096];
+    FILE *txt = tmpfile();
+    write_task_line(txt, in);
+    rewind(txt);
+    char *read = fgets(line, sizeof(line), txt);
+    fclose(txt);
+    return read == NULL ? -1 : parse_task_line(line, out);
+}
+
+
+static void test_roundtrip() {
+    Task in;
+    memset(&in, 0, sizeof(in));
+    in.id = 42;
+    strcpy(in.command, "echo 'a b' | tr a b > out.txt");
+    in.interval_seconds = 90;
+    in.last_run = 1700000000;
+    in.active = false;
+    strcpy(in.tags, "etl,nightly");
+    strcpy(in.group, "data");
+    in.last_status = 3;
+    strcpy(in.cwd, "/srv/site");
+    strcpy(in.env, "MODE=full;EMPTY=");
+    in.umask = 027;
+    in.priority = PRIORITY_LOW;
+    in.deadline_seconds = 30;
+    strcpy(in.watch, "inbox/");
+    in.debounce_ms = 0;
+
+    Task out;
+    CHECK_INT(roundtrip(&in, &out), 0);
+    CHECK_INT(out.id, 42);
+    CHECK_STR(out.command, in.command);
+    CHECK_INT(out.interval_seconds, 90);
+    CHECK_INT(out.last_run, 1700000000);
+    CHECK(!out.active);
+    CHECK_STR(out.tags, "etl,nightly");
+    CHECK_STR(out.group, "data");
+    CHECK_INT(out.last_status, 3);
+    CHECK_STR(out.cwd, "/srv/site");
+    CHECK_STR(out.env, "MODE=full;EMPTY=");
+    CHECK_INT(out.umask, 027);
+    CHECK_INT(out.priority, PRIORITY_LOW);
+    CHECK_INT(out.deadline_seconds, 30);
+    CHECK_STR(out.watch, "inbox/");
+    CHECK_INT(out.debounce_ms, 0);
+
+    // Empty optional fields & inherited umask
+    in.tags[0] = '\0';
+    in.group[0] = '\0';
+    in.cwd[0] = '\0';
+    in.env[0] = '\0';
+    in.watch[0] = '\0';
+    in.umask = UMASK_INHERIT;
+    in.last_status = STATUS_NONE;
+    CHECK_INT(roundtrip(&in, &out), 0);
+    CHECK_STR(out.tags, "");
+    CHECK_STR(out.cwd, "");
+    CHECK_STR(out.watch, "");
+    CHECK_INT(out.umask, UMASK_INHERIT);
+    CHECK_INT(out.last_status, STATUS_NONE);
+}
+
+
+// Bytes of the multi-byte delimiter on their own must not split fields (the old strtok bug)
+static void test_delimiter_bytes() {
+    Task in;
+    memset(&in, 0, sizeof(in));
+    in.id = 1;
+    strcpy(in.command, "echo \xe2\x96 caf\xc3\xa9 \x88\xe2 \xe2\x94\x80");
+    in.interval_seconds = 5;
+    in.active = true;
+    in.umask = UMASK_INHERIT;
+    in.last_status = STATUS_NONE;
+
+    Task out;
+    CHECK_INT(roundtrip(&in, &out), 0);
+    CHECK_STR(out.command, in.command);
+    CHECK_INT(out.interval_seconds, 5);
+    CHECK(out.active);
+}
+
+
+static void test_legacy_lines() {
+    Task t;
+
+    // Original 5 field format gets defaults for everything added later
+    char line[] = "7█ls -la█60█1600000000█1\n";
+    CHECK_INT(parse_task_line(line, &t), 0);
+    CHECK_INT(t.id, 7);
+    CHECK_STR(t.command, "ls -la");
+    CHECK_INT(t.interval_seconds, 60);
+    CHECK_INT(t.last_run, 1600000000);
+    CHECK(t.active);
+    CHECK_STR(t.tags, "");
+    CHECK_INT(t.last_status, STATUS_NONE);
+    CHECK_INT(t.umask, UMASK_INHERIT);
+    CHECK_INT(t.priority, PRIORITY_NORMAL);
+    CHECK_STR(t.watch, "");
+    CHECK_INT(t.debounce_ms, DEFAULT_DEBOUNCE_MS);
+
+    // Out of range priority falls back to normal
+    char priority[] = "8█true█1█0█1███████9█0\n";
+    CHECK_INT(parse_task_line(priority, &t), 0);
+    CHECK_INT(t.priority, PRIORITY_NORMAL);
+}
+
+
+static void test_malformed_lines() {
+    Task t;
+    char empty[] = "\n";
+    char short_line[] = "1█echo█5█0\n";
+    char no_id[] = "█echo█5█0█1\n";
+    char no_command[] = "1██5█0█1\n";
+    CHECK_INT(parse_task_line(empty, &t), -1);
+    CHECK_INT(parse_task_line(short_line, &t), -1);
+    CHECK_INT(parse_task_line(no_id, &t), -1);
+    CHECK_INT(parse_task_line(no_command, &t), -1);
+
+    // Overlong fields are cut to their buffer size
+    char line[4096];
+    char *pos = line;
+    pos += sprintf(pos, "3█");
+    memset(pos, 'x', 1000);
+    pos += 1000;
+    pos += sprintf(pos, "█1█0█1█");
+    memset(pos, 't', 400);
+    pos[400] = '\0';
+    CHECK_INT(parse_task_line(line, &t), 0);
+    CHECK_INT(strlen(t.command), MAX_COMMAND_LEN - 1);
+    CHECK_INT(strlen(t.tags), MAX_TAGS_LEN - 1);
+}
+
+
+// A field that would break the line is saved empty instead of adding a phantom task
+static void test_corrupting_fields() {
+    Task in;
+    memset(&in, 0, sizeof(in));
+    in.id = 7;
+    strcpy(in.command, "true");
+    in.interval_seconds = 5;
+    in.active = true;
+    strcpy(in.cwd, "/tmp\nx");
+    strcpy(in.env, "A=b");
+    in.umask = UMASK_INHERIT;
+
+    char buffer[4096];
+    FILE *txt = fmemopen(buffer, sizeof(buffer), "w");
+    write_task_line(txt, &in);
+    fclose(txt);
+    CHECK_INT(strchr(buffer, '\n') - buffer, strlen(buffer) - 1);
+
+    Task out;
+    CHECK_INT(roundtrip(&in, &out), 0);
+    CHECK_INT(out.id, 7);
+    CHECK_STR(out.cwd, "");
+    CHECK_STR(out.env, "A=b");
+
+    // Windows line endings are fine, a stray carriage return inside a field isn't
+    char crlf[] = "3█ls█5█0█1\r\n";
+    CHECK_INT(parse_task_line(crlf, &out), 0);
+    CHECK_STR(out.command, "ls");
+    char stray[] = "3█ls\rx█5█0█1\n";
+    CHECK_INT(parse_task_line(stray, &out), -1);
+}
+
+
+static void test_validation() {
+    CHECK(valid_command("echo hi"));
+    CHECK(!valid_command(""));
+    CHECK(!valid_command("echo █"));
+    CHECK(!valid_command("echo a\necho b"));
+    char long_command[MAX_COMMAND_LEN + 1];
+    memset(long_command, 'a', MAX_COMMAND_LEN);
+    long_command[MAX_COMMAND_LEN] = '\0';
+    CHECK(!valid_command(long_command));
+
+    CHECK(valid_field("/tmp/a b"));
+    CHECK(valid_field(""));
+    CHECK(!valid_field("/tmp\nx"));
+    CHECK(!valid_field("/tmp\rx"));
+    CHECK(!valid_field("a█b"));
+
+    CHECK(valid_label("etl,nightly", true));
+    CHECK(!valid_label("etl,nightly", false));
+    CHECK(!valid_label("", true));
+    CHECK(!valid_label("a b", true));
+
+    CHECK(valid_env_entry("PATH=/bin"));
+    CHECK(valid_env_entry("EMPTY="));
+    CHECK(!valid_env_entry("=x"));
+    CHECK(!valid_env_entry("1A=x"));
+    CHECK(!valid_env_entry("A=x;B=y"));
+    CHECK(!valid_env_entry("NOVALUE"));
+
+    Priority priority;
+    CHECK_INT(parse_priority("critical", &priority), 0);
+    CHECK_INT(priority, PRIORITY_CRITICAL);
+    CHECK_INT(parse_priority("urgent", &priority), 1);
+}
+
+
+// Add, save, reload & edit through the task file in a temporary directory
+static void test_save_load() {
+    load_tasks();
+    int first = add_task("echo one", 10);
+    int second = add_task("echo two", 20);
+    int third = add_task("echo three", 30);
+    CHECK_INT(first, 1);
+    CHECK_INT(third, 3);
+    CHECK_INT(set_task_labels(second, "a,b", "g"), 0);
+    CHECK_INT(set_task_trigger(third, "in", 50), 0);
+    CHECK_INT(set_task_labels(99, "x", NULL), 1);
+    CHECK_INT(save_tasks(), SAVE_OK);
+
+    load_tasks();
+    CHECK(task_exists(first) && task_exists(second) && task_exists(third));
+    CHECK_INT(delete_task(second), 0);
+    CHECK_INT(pause_task(first), 0);
+    CHECK_INT(pause_task(first), -1);
+    CHECK_INT(save_tasks(), SAVE_OK);
+
+    // Ids of deleted tasks aren't handed out again
+    load_tasks();
+    CHECK(!task_exists(second));
+    CHECK_INT(add_task("echo four", 40), 4);
+    CHECK_INT(set_active_by_tag("missing", true), 0);
+
+    // Someone else saved since our load: refuse to overwrite their change
+    FILE *txt = fopen("tasks.txt", "a");
+    CHECK(txt != NULL);
+    if (txt != NULL) {
+        fprintf(txt, "9█echo other█5█0█1\n");
+        fclose(txt);
+    }
+    txt = fopen("tasks.txt", "r+");
+    if (txt != NULL) {
+        // Same length as the current header, so the rest of the file stays intact
+        fprintf(txt, "#flux version=9");
+        fclose(txt);
+    }
+    CHECK_INT(save_tasks(), SAVE_CONFLICT);
+
+    // After reloading both changes are kept
+    load_tasks();
+    CHECK(task_exists(9));
+    CHECK(!task_exists(4));
+    int added = add_task("echo four", 40);
+    CHECK(added > 9);
+    CHECK_INT(save_tasks(), SAVE_OK);
+    load_tasks();
+    CHECK(task_exists(9) && task_exists(added));
+}
+
+
+int main() {
+    test_enter_tempdir();
+    test_roundtrip();
+    test_delimiter_bytes();
+    test_legacy_lines();
+    test_malformed_lines();
+    test_validation();
+    test_corrupting_fields();
+    test_save_load();
+    return test_finish("test_task");
+}
@@ -0,0 +1,145 @@
+#include "test.h"
+#include "trigger.h"
+#include <sys/stat.h>
+
+
+// Wait up to limit_ms for triggers, returns how many ids were collected
+static int collect_within(int limit_ms, int *ids, int max_ids) {
+    for (int waited = 0; waited <= limit_ms; waited += 10) {
+        int count = trigger_collect(ids, max_ids);
+        if (count > 0) {
+            return count;
+        }
+        long next = trigger_next_ms();
+        trigger_wait(next >= 0 && next < 10 ? next : 10, -1);
+    }
+    return 0;
+}
+
+
+static void touch(const char *path) {
+    FILE *file = fopen(path, "a");
+    if (file != NULL) {
+        fputs("x", file);
+        fclose(file);
+    }
+}
+
+
+static void test_run_queue() {
+    int ids[16];
+    CHECK_INT(trigger_collect(ids, 16), 0);
+
+    CHECK_INT(queue_run(5), 0);
+    CHECK_INT(queue_run(5), 0);
+    CHECK_INT(queue_run(8), 0);
+    // Queued twice, run once
+    CHECK_INT(collect_within(500, ids, 16), 2);
+    CHECK_INT(ids[0], 5);
+    CHECK_INT(ids[1], 8);
+    CHECK_INT(trigger_collect(ids, 16), 0);
+
+    // Deferred runs come back on the next collect
+    trigger_requeue(8);
+    CHECK_INT(trigger_collect(ids, 16), 1);
+    CHECK_INT(ids[0], 8);
+}
+
+
+static void test_watches() {
+    mkdir("inbox", 0755);
+    Task tasks[2];
+    memset(tasks, 0, sizeof(tasks));
+    tasks[0].id = 1;
+    tasks[0].active = true;
+    strcpy(tasks[0].watch, "inbox");
+    tasks[0].debounce_ms = 50;
+    // Paused tasks aren't watched
+    tasks[1].id = 2;
+    tasks[1].active = false;
+    strcpy(tasks[1].watch, "inbox");
+    trigger_sync(tasks, 2);
+
+    int ids[16];
+    CHECK_INT(trigger_next_ms(), -1);
+
+    // A burst of changes runs the task once
+    for (int i = 0; i < 5; i++) {
+        char path[32];
+        snprintf(path, sizeof(path), "inbox/file%d", i);
+        touch(path);
+    }
+    CHECK_INT(collect_within(1000, ids, 16), 1);
+    CHECK_INT(ids[0], 1);
+    trigger_wait(100, -1);
+    CHECK_INT(trigger_collect(ids, 16), 0);
+
+    // Watched path that doesn't exist yet fires once it's created
+    strcpy(tasks[1].watch, "later.txt");
+    tasks[1].active = true;
+    tasks[1].debounce_ms = 0;
+    trigger_sync(tasks, 2);
+    touch("later.txt");
+    CHECK_INT(collect_within(2000, ids, 16), 1);
+    CHECK_INT(ids[0], 2);
+
+    // Replacing the file with a rename fires again
+    touch("later.tmp");
+    rename("later.tmp", "later.txt");
+    CHECK_INT(collect_within(1000, ids, 16), 1);
+    CHECK_INT(ids[0], 2);
+
+    // Dropped watches don't fire anymore
+    tasks[0].active = false;
+    trigger_sync(tasks, 2);
+    touch("inbox/file9");
+    trigger_wait(200, -1);
+    CHECK_INT(trigger_collect(ids, 16), 0);
+}
+
+
+static void test_own_directory() {
+    touch(LOG_FILE);
+    touch(TASK_FILE ".a1B2c3");
+    touch("trace.json");
+    Task task;
+    memset(&task, 0, sizeof(task));
+    task.id = 3;
+    task.active = true;
+    strcpy(task.watch, ".");
+    trigger_sync(&task, 1);
+
+    // The scheduler's own files don't count as changes, or every logged run would trigger the next
+    int ids[16];
+    touch(LOG_FILE);
+    touch(TASK_FILE ".a1B2c3");
+    touch("trace.json");
+    touch("tasks.lock");
+    touch("tasks.state");
+    trigger_wait(200, -1);
+    CHECK_INT(trigger_collect(ids, 16), 0);
+
+    // Anything else in the directory does, even with a name close to one of them
+    touch("report.csv");
+    CHECK_INT(collect_within(1000, ids, 16), 1);
+    CHECK_INT(ids[0], 3);
+    touch("tasks.csv");
+    CHECK_INT(collect_within(1000, ids, 16), 1);
+    touch("trace.log");
+    CHECK_INT(collect_within(1000, ids, 16), 1);
+
+    trigger_sync(NULL, 0);
+}
+
+
+int main() {
+    test_enter_tempdir();
+    if (trigger_init() != 0) {
+        printf("No change notifications, polling paths instead\n");
+    }
+    test_run_queue();
+    test_watches();
+    test_own_directory();
+    trigger_close();
+    return test_finish("test_trigger");
+}
@@ -0,0 +1,108 @@
+#!/bin/sh
+# Benchmark workload: the common paths of the CLI & the scheduler on a realistic amount of data.
+# Used to train profile guided builds ('make pgo'), and prints how long each step took.
+#
+# Usage: tests/workload.sh [flux binary]
+# Settings: TASKS (tasks added), LOG_LINES (history size), RUN_SECONDS (scheduler run time)
+
+set -u
+
+FLUX=${1:-"$(cd "$(dirname "$0")/.." && pwd)/flux"}
+case $FLUX in
+    /*) ;;
+    *) FLUX="$(pwd)/$FLUX" ;;
+esac
+if [ ! -x "$FLUX" ]; then
+    echo "No flux binary at $FLUX" >&2
+    exit 1
+fi
+TASKS=${TASKS:-2000}
+LOG_LINES=${LOG_LINES:-200000}
+RUN_SECONDS=${RUN_SECONDS:-5}
+
+dir=$(mktemp -d /tmp/flux-workload.XXXXXX)
+cd "$dir" || exit 1
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+step_start=0
+step() {
+    step_start=$(now_ms)
+    printf '%-28s' "$1"
+}
+done_step() {
+    echo "$(($(now_ms) - step_start)) ms"
+}
+
+
+# Task file with tags, groups & a mix of settings (each add reloads & rewrites the whole file)
+step "add $TASKS tasks"
+for i in $(seq 1 "$TASKS"); do
+    case $((i % 4)) in
+        0) "$FLUX" add "echo $i" $((30 + i % 600)) --tags "etl,n$((i % 10))" --group "g$((i % 7))" ;;
+        1) "$FLUX" add "true" $((60 + i % 3600)) --priority low --deadline 120 ;;
+        2) "$FLUX" add "echo $i > /dev/null" 3600 --tags web --cwd /tmp --env "N=$i" ;;
+        3) "$FLUX" add "true" 0 --watch "in$((i % 5))" --debounce 50 ;;
+    esac
+done > /dev/null 2>&1
+done_step
+
+step "edit tasks"
+for i in $(seq 1 200); do
+    "$FLUX" pause $((i * 7 % TASKS + 1))
+    "$FLUX" tag $((i * 11 % TASKS + 1)) "etl,x$i" "g$((i % 3))"
+done > /dev/null 2>&1
+"$FLUX" pause --tag web > /dev/null
+"$FLUX" resume --tag web > /dev/null
+done_step
+
+step "list queries"
+for i in $(seq 1 20); do
+    "$FLUX" list
+    "$FLUX" list --format compact --sort next
+    "$FLUX" list --tag etl --status never --format json
+    "$FLUX" list --group "g$((i % 7))" --active --sort interval --desc --limit 50
+    "$FLUX" list --due 300 --grep echo --format compact
+done > /dev/null
+done_step
+
+# History in the current log format, with some older lines mixed in
+awk -v lines="$LOG_LINES" 'BEGIN {
+    for (i = 0; i < lines; i++) {
+        id = i % 500 + 1
+        if (i % 50 == 0) {
+            printf "[2024-01-%02d %02d:%02d:%02d] Ran task #%d: echo %d\n", i % 28 + 1, i % 24, i % 60, i % 60, id, id
+        } else {
+            printf "[2024-01-%02d %02d:%02d:%02d] Ran task #%d (exit %d, %d ms): echo %d\n", i % 28 + 1, i % 24, i % 60, i % 60, id, (i % 13 == 0), i % 2000, id
+        }
+    }
+}' > task_logs.txt
+
+step "history $LOG_LINES lines"
+for i in 1 2 3; do
+    "$FLUX" history --report
+    "$FLUX" history $((i * 17))
+done > /dev/null
+done_step
+
+# Scheduler with many due tasks, path triggers & on-demand runs
+step "scheduler ${RUN_SECONDS}s"
+mkdir -p in0 in1 in2 in3 in4
+"$FLUX" add "true" 1 --priority critical > /dev/null
+"$FLUX" start > /dev/null 2>&1
+end=$(($(date +%s) + RUN_SECONDS))
+i=0
+while [ "$(date +%s)" -lt "$end" ]; do
+    touch "in$((i % 5))/f$i"
+    "$FLUX" run $((i % TASKS + 1)) > /dev/null
+    "$FLUX" status > /dev/null
+    i=$((i + 1))
+    sleep 0.1
+done
+"$FLUX" stop > /dev/null
+sleep 1
+done_step
+
+cd / && rm -rf "$dir"
@@ -0,0 +1,206 @@
+#include "trace.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_USE_TSC 1
+#endif
+
+
+// Events kept per thread, oldest ones get overwritten when full (power of 2)
+#define TRACE_RING_SIZE 65536
+
+// One finished span
+typedef struct {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+    int arg;
+} TraceEvent;
+
+// Single producer ring buffer owned by one thread
+typedef struct TraceRing {
+    TraceEvent events[TRACE_RING_SIZE];
+    // Total events ever written, only the owning thread writes it
+    _Atomic uint64_t head;
+    int tid;
+    struct TraceRing *next;
+} TraceRing;
+
+bool trace_enabled = false;
+
+// Every ring ever created, rings are never freed so the list only grows
+static _Atomic(TraceRing *) all_rings = NULL;
+static atomic_int next_tid = 1;
+static _Thread_local TraceRing *local_ring = NULL;
+
+// Clock readings taken when tracing started, used to convert ticks to microseconds
+static uint64_t start_ticks;
+static uint64_t start_ns;
+
+// When the current trace request ends (0 if none is running)
+static time_t trace_deadline = 0;
+
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+
+uint64_t trace_now() {
+#ifdef TRACE_USE_TSC
+    return __rdtsc();
+#else
+    return monotonic_ns();
+#endif
+}
+
+
+// Create the ring buffer of the calling thread & add it to the global list
+static TraceRing *create_ring() {
+    TraceRing *ring = calloc(1, sizeof(TraceRing));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->tid = atomic_fetch_add(&next_tid, 1);
+
+    // Lock-free push onto the front of the list
+    TraceRing *head = atomic_load(&all_rings);
+    do {
+        ring->next = head;
+    } while (!atomic_compare_exchange_weak(&all_rings, &head, ring));
+
+    return ring;
+}
+
+
+void trace_record(const char *name, uint64_t start, int arg) {
+    // Span began before tracing was switched on
+    if (start == 0) {
+        return;
+    }
+
+    TraceRing *ring = local_ring;
+    if (ring == NULL) {
+        ring = local_ring = create_ring();
+        if (ring == NULL) {
+            return;
+        }
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    TraceEvent *event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+    event->name = name;
+    event->start = start;
+    event->end = trace_now();
+    event->arg = arg;
+
+    // Publish the event to the exporter
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+
+void trace_start() {
+    // Drop events from any earlier trace
+    for (TraceRing *ring = atomic_load(&all_rings); ring != NULL; ring = ring->next) {
+        atomic_store(&ring->head, 0);
+    }
+
+    start_ns = monotonic_ns();
+    start_ticks = trace_now();
+    trace_enabled = true;
+}
+
+
+void trace_stop() {
+    trace_enabled = false;
+}
+
+
+int trace_export(const char *filename) {
+    // Work out how long a tick is by comparing against the monotonic clock
+    double ns_per_tick = 1.0;
+#ifdef TRACE_USE_TSC
+    uint64_t now_ticks = trace_now();
+    uint64_t now_ns = monotonic_ns();
+    if (now_ticks > start_ticks && now_ns > start_ns) {
+        ns_per_tick = (double)(now_ns - start_ns) / (double)(now_ticks - start_ticks);
+    }
+#endif
+
+    // Write to a temp file first so readers never see a half written trace
+    char temp_name[256];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+    FILE *out = fopen(temp_name, "w");
+    if (!out) {
+        perror("Failed to write trace");
+        return -1;
+    }
+
+    int pid = (int)getpid();
+    int written = 0;
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (TraceRing *ring = atomic_load(&all_rings); ring != NULL; ring = ring->next) {
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+        for (uint64_t i = first; i < head; i++) {
+            const TraceEvent *event = &ring->events[i & (TRACE_RING_SIZE - 1)];
+            // Timestamps in microseconds since tracing started
+            double ts = (double)(event->start - start_ticks) * ns_per_tick / 1000.0;
+            double dur = (double)(event->end - event->start) * ns_per_tick / 1000.0;
+
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"flux\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                    written > 0 ? ",\n" : "", event->name, ts, dur, pid, ring->tid);
+            if (event->arg >= 0) {
+                fprintf(out, ",\"args\":{\"task\":%d}", event->arg);
+            }
+            fprintf(out, "}");
+            written++;
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+    if (fclose(out) != 0 || rename(temp_name, filename) != 0) {
+        perror("Failed to write trace");
+        return -1;
+    }
+    return written;
+}
+
+
+void trace_poll() {
+    // Finish a running trace once its time is up. A request that comes in meanwhile stays
+    // queued in its file until this trace has been exported.
+    if (trace_deadline != 0) {
+        if (time(NULL) >= trace_deadline) {
+            trace_stop();
+            trace_export(TRACE_OUTPUT_FILE);
+            trace_deadline = 0;
+        }
+        return;
+    }
+
+    // Check if the CLI asked for a trace
+    FILE *request = fopen(TRACE_REQUEST_FILE, "r");
+    if (request == NULL) {
+        return;
+    }
+
+    int duration = 0;
+    if (fscanf(request, "%d", &duration) != 1 || duration <= 0) {
+        duration = 5;
+    }
+    fclose(request);
+    remove(TRACE_REQUEST_FILE);
+
+    trace_deadline = time(NULL) + duration;
+    trace_start();
+}
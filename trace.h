@@ -0,0 +1,49 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// File the CLI drops to ask the scheduler for a trace (contains the duration)
+#define TRACE_REQUEST_FILE "trace.request"
+// File the scheduler writes the finished trace to
+#define TRACE_OUTPUT_FILE "trace.json"
+// Held by the CLI for as long as it waits on a trace, so only one is asked for at a time
+#define TRACE_LOCK_FILE "trace.lock"
+
+// Only read through the TRACE_* macros so a disabled trace costs a single branch
+extern bool trace_enabled;
+
+#if defined(__GNUC__)
+#define TRACE_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define TRACE_UNLIKELY(x) (x)
+#endif
+
+// Start a span, stores the start timestamp in var
+#define TRACE_BEGIN(var) uint64_t var = TRACE_UNLIKELY(trace_enabled) ? trace_now() : 0
+
+// End a span started with TRACE_BEGIN, arg is shown in the trace (-1 for none)
+#define TRACE_END(var, name, arg) \
+    do { \
+        if (TRACE_UNLIKELY(trace_enabled)) trace_record((name), (var), (arg)); \
+    } while (0)
+
+// Current timestamp in trace clock ticks
+uint64_t trace_now();
+
+// Store a finished span in the calling thread's ring buffer
+void trace_record(const char *name, uint64_t start, int arg);
+
+// Start & stop recording spans
+void trace_start();
+
+void trace_stop();
+
+// Write recorded spans as Chrome trace-event JSON, returns number of events or -1 on failure
+int trace_export(const char *filename);
+
+// Called once per scheduler loop, handles trace requests from the CLI
+void trace_poll();
+
+#endif
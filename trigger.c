@@ -0,0 +1,478 @@
+#include "trigger.h"
+#include "store.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+
+// A burst of changes is run once, at most this many debounce periods after its first change
+#define MAX_DEBOUNCE_PERIODS 10
+// How often paths are checked when change notifications aren't available
+#define FALLBACK_POLL_MS 100
+// How often missing watch paths are looked for again
+#define RETRY_MS 1000
+// Runs waiting to be collected, more 'flux run' requests than this are dropped
+#define MAX_PENDING_RUNS 4096
+
+#ifdef __linux__
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+// A task waiting for changes to a path
+typedef struct {
+    int task_id;
+    char path[MAX_PATH_LEN];
+    int debounce_ms;
+    // Notification watch, -1 until the path exists
+    int wd;
+    // First change not run yet (0 if none) & when the debounced run fires
+    long long first_ms;
+    long long fire_ms;
+    // Last seen state of the path, used when polling instead of notifications
+    bool exists;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    time_t ctime;
+} Watch;
+
+static Watch *watches = NULL;
+static int watch_count = 0;
+
+// Ids asked for by 'flux run' or put back with trigger_requeue()
+static int pending_runs[MAX_PENDING_RUNS];
+static int pending_count = 0;
+
+// Notification descriptor & the watch on the scheduler's directory (-1 when polling)
+static int notify_fd = -1;
+static int control_wd = -1;
+static long long last_retry_ms = 0;
+
+
+static long long now_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+static void add_pending(int task_id) {
+    for (int i = 0; i < pending_count; i++) {
+        if (pending_runs[i] == task_id) {
+            return;
+        }
+    }
+    if (pending_count < MAX_PENDING_RUNS) {
+        pending_runs[pending_count++] = task_id;
+    }
+}
+
+
+// Remember what a path looks like now, returns true if it changed since last time
+static bool snapshot(Watch *w) {
+    struct stat st;
+    bool exists = stat(w->path, &st) == 0;
+    bool changed = exists != w->exists;
+    if (exists) {
+        changed = changed || st.st_ino != w->ino || st.st_size != w->size ||
+                  st.st_mtime != w->mtime || st.st_ctime != w->ctime;
+        w->ino = st.st_ino;
+        w->size = st.st_size;
+        w->mtime = st.st_mtime;
+        w->ctime = st.st_ctime;
+    }
+    w->exists = exists;
+    return changed;
+}
+
+
+// Record a change, the run fires once the path has been quiet for the debounce time
+static void mark_changed(Watch *w, long long now) {
+    if (w->first_ms == 0) {
+        w->first_ms = now;
+    }
+    long long latest = w->first_ms + (long long)w->debounce_ms * MAX_DEBOUNCE_PERIODS;
+    w->fire_ms = now + w->debounce_ms;
+    if (w->fire_ms > latest) {
+        w->fire_ms = latest;
+    }
+}
+
+
+// Start watching a path if it exists by now
+static void attach(Watch *w) {
+#ifdef __linux__
+    if (notify_fd >= 0 && w->wd < 0) {
+        w->wd = inotify_add_watch(notify_fd, w->path, WATCH_EVENTS);
+    }
+#else
+    (void)w;
+#endif
+}
+
+
+// Stop watching a path unless another watch shares the descriptor
+static void detach(int wd, const Watch *keep, int keep_count) {
+#ifdef __linux__
+    if (notify_fd < 0 || wd < 0 || wd == control_wd) {
+        return;
+    }
+    for (int i = 0; i < keep_count; i++) {
+        if (keep[i].wd == wd) {
+            return;
+        }
+    }
+    inotify_rm_watch(notify_fd, wd);
+#else
+    (void)wd;
+    (void)keep;
+    (void)keep_count;
+#endif
+}
+
+
+int trigger_init() {
+#ifdef __linux__
+    notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify_fd < 0) {
+        return -1;
+    }
+    // Wakes the scheduler for 'flux run', task edits & 'flux stop'
+    control_wd = inotify_add_watch(notify_fd, ".", WATCH_EVENTS);
+    if (control_wd < 0) {
+        close(notify_fd);
+        notify_fd = -1;
+        return -1;
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+
+void trigger_close() {
+    if (notify_fd >= 0) {
+        close(notify_fd);
+        notify_fd = -1;
+        control_wd = -1;
+    }
+    free(watches);
+    watches = NULL;
+    watch_count = 0;
+}
+
+
+void trigger_sync(const Task *tasks, int count) {
+    int needed = 0;
+    for (int i = 0; i < count; i++) {
+        if (tasks[i].active && tasks[i].watch[0] != '\0') {
+            needed++;
+        }
+    }
+
+    Watch *updated = needed > 0 ? calloc((size_t)needed, sizeof(Watch)) : NULL;
+    if (needed > 0 && updated == NULL) {
+        return;
+    }
+
+    // Keep the state of watches that didn't change, so pending changes survive reloads
+    int updated_count = 0;
+    for (int i = 0; i < count; i++) {
+        const Task *t = &tasks[i];
+        if (!t->active || t->watch[0] == '\0') {
+            continue;
+        }
+
+        Watch *w = &updated[updated_count++];
+        int old = -1;
+        for (int j = 0; j < watch_count; j++) {
+            if (watches[j].task_id == t->id && strcmp(watches[j].path, t->watch) == 0) {
+                old = j;
+                break;
+            }
+        }
+
+        if (old >= 0) {
+            *w = watches[old];
+            // Claimed, so detach() below leaves it alone
+            watches[old].task_id = 0;
+        } else {
+            w->task_id = t->id;
+            strncpy(w->path, t->watch, MAX_PATH_LEN - 1);
+            w->wd = -1;
+            snapshot(w);
+            attach(w);
+        }
+        w->debounce_ms = t->debounce_ms;
+    }
+
+    for (int j = 0; j < watch_count; j++) {
+        if (watches[j].task_id != 0) {
+            detach(watches[j].wd, updated, updated_count);
+        }
+    }
+
+    free(watches);
+    watches = updated;
+    watch_count = updated_count;
+}
+
+
+#ifdef __linux__
+// Files the scheduler & CLI keep in the scheduler's directory. A task watching that directory
+// shares its descriptor, & would otherwise run again every time its own run gets logged.
+// Matched by exact name so user files next to them (ex. tasks.csv) still trigger.
+static bool own_file(const char *name) {
+    static const char *names[] = { TASK_FILE, LOCK_FILE, STATE_FILE, LOG_FILE, RUN_QUEUE_FILE, DAEMON_LOCK_FILE,
+                                   "scheduler.running", TRACE_REQUEST_FILE, TRACE_OUTPUT_FILE,
+                                   TRACE_OUTPUT_FILE ".tmp", TRACE_LOCK_FILE };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return true;
+        }
+    }
+    // Temporary copy save_tasks() renames over the task file (mkstemp of TASK_FILE ".XXXXXX")
+    size_t prefix = strlen(TASK_FILE ".");
+    return strncmp(name, TASK_FILE ".", prefix) == 0 && strlen(name) == prefix + 6;
+}
+
+
+// Read queued notifications, returns true if one of them needs the scheduler's attention
+static bool read_events() {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool woke = false;
+    long long now = now_ms();
+
+    while (true) {
+        ssize_t len = read(notify_fd, buffer, sizeof(buffer));
+        if (len <= 0) {
+            break;
+        }
+
+        for (char *pos = buffer; pos < buffer + len;) {
+            const struct inotify_event *event = (const struct inotify_event *)pos;
+            pos += sizeof(struct inotify_event) + event->len;
+
+            // Lost events, treat every path as changed
+            if (event->mask & IN_Q_OVERFLOW) {
+                for (int i = 0; i < watch_count; i++) {
+                    mark_changed(&watches[i], now);
+                }
+                woke = true;
+                continue;
+            }
+
+            bool own = event->wd == control_wd && event->len > 0 && own_file(event->name);
+            if (own && (strcmp(event->name, RUN_QUEUE_FILE) == 0 || strcmp(event->name, TASK_FILE) == 0 ||
+                        strcmp(event->name, "scheduler.running") == 0)) {
+                woke = true;
+            }
+
+            // Path was removed or moved away (the watch would follow it), look for it again
+            bool gone = (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) != 0;
+            if ((event->mask & IN_MOVE_SELF) && event->wd != control_wd) {
+                inotify_rm_watch(notify_fd, event->wd);
+            }
+
+            for (int i = 0; i < watch_count && !own; i++) {
+                if (watches[i].wd != event->wd) {
+                    continue;
+                }
+                if (gone) {
+                    // Usually replaced right away (ex. saved through a rename)
+                    watches[i].wd = -1;
+                    attach(&watches[i]);
+                }
+                mark_changed(&watches[i], now);
+                woke = true;
+            }
+        }
+    }
+    return woke;
+}
+#endif
+
+
+// Look for changes by comparing each path with its last snapshot
+static bool poll_paths() {
+    bool changed = false;
+    long long now = now_ms();
+    for (int i = 0; i < watch_count; i++) {
+        if (snapshot(&watches[i])) {
+            mark_changed(&watches[i], now);
+            changed = true;
+        }
+    }
+
+    struct stat st;
+    return changed || (stat(RUN_QUEUE_FILE, &st) == 0 && st.st_size > 0);
+}
+
+
+void trigger_wait(long timeout_ms, int wake_fd) {
+    long long until = now_ms() + (timeout_ms > 0 ? timeout_ms : 0);
+
+    while (true) {
+        long long remaining = until - now_ms();
+        if (remaining < 0) {
+            remaining = 0;
+        }
+
+#ifdef __linux__
+        if (notify_fd >= 0) {
+            struct pollfd fds[2] = { { notify_fd, POLLIN, 0 }, { wake_fd, POLLIN, 0 } };
+            int ready = poll(fds, 2, (int)remaining);
+            if (ready <= 0 || fds[1].revents != 0 || read_events() || remaining == 0) {
+                return;
+            }
+            continue;
+        }
+#endif
+
+        if (remaining > FALLBACK_POLL_MS) {
+            remaining = FALLBACK_POLL_MS;
+        }
+        // Negative descriptors are ignored by poll()
+        struct pollfd fd = { wake_fd, POLLIN, 0 };
+        if (poll(&fd, 1, (int)remaining) > 0 || poll_paths() || now_ms() >= until) {
+            return;
+        }
+    }
+}
+
+
+long trigger_next_ms() {
+    long long now = now_ms();
+    long long next = -1;
+    for (int i = 0; i < watch_count; i++) {
+        if (watches[i].first_ms != 0 && (next < 0 || watches[i].fire_ms < next)) {
+            next = watches[i].fire_ms;
+        }
+    }
+    if (next < 0) {
+        return -1;
+    }
+    return next > now ? (long)(next - now) : 0;
+}
+
+
+// Move ids from the run queue into pending runs
+static void read_run_queue() {
+    struct stat st;
+    if (stat(RUN_QUEUE_FILE, &st) != 0 || st.st_size == 0) {
+        return;
+    }
+
+    int fd = open(RUN_QUEUE_FILE, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    // Writers hold the lock while appending, so nothing is lost between reading & truncating
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            close(fd);
+            return;
+        }
+    }
+
+    char buffer[4096];
+    char number[16];
+    size_t digits = 0;
+    ssize_t len;
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < len; i++) {
+            if (buffer[i] >= '0' && buffer[i] <= '9' && digits < sizeof(number) - 1) {
+                number[digits++] = buffer[i];
+            } else if (buffer[i] == '\n') {
+                number[digits] = '\0';
+                if (digits > 0 && atoi(number) > 0) {
+                    add_pending(atoi(number));
+                }
+                digits = 0;
+            }
+        }
+    }
+
+    if (ftruncate(fd, 0) != 0) {
+        perror("Failed to empty run queue");
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+
+int trigger_collect(int *ids, int max_ids) {
+    long long now = now_ms();
+
+    // Paths that didn't exist before may have been created since, which counts as a change
+    if (notify_fd >= 0 && now - last_retry_ms >= RETRY_MS) {
+        last_retry_ms = now;
+        for (int i = 0; i < watch_count; i++) {
+            if (watches[i].wd < 0) {
+                attach(&watches[i]);
+                if (watches[i].wd >= 0) {
+                    mark_changed(&watches[i], now);
+                }
+            }
+        }
+    }
+
+    read_run_queue();
+
+    int count = 0;
+    for (int i = 0; i < watch_count && count < max_ids; i++) {
+        if (watches[i].first_ms != 0 && now >= watches[i].fire_ms) {
+            ids[count++] = watches[i].task_id;
+            watches[i].first_ms = 0;
+        }
+    }
+
+    // Hand out queued runs, anything that doesn't fit stays for next time
+    int taken = 0;
+    while (taken < pending_count && count < max_ids) {
+        ids[count++] = pending_runs[taken++];
+    }
+    memmove(pending_runs, pending_runs + taken, (size_t)(pending_count - taken) * sizeof(int));
+    pending_count -= taken;
+
+    return count;
+}
+
+
+void trigger_requeue(int task_id) {
+    add_pending(task_id);
+}
+
+
+int queue_run(int task_id) {
+    int fd = open(RUN_QUEUE_FILE, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    char line[16];
+    int len = snprintf(line, sizeof(line), "%d\n", task_id);
+    bool written = write(fd, line, (size_t)len) == len;
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return written ? 0 : -1;
+}
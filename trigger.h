@@ -0,0 +1,33 @@
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include "task.h"
+
+// File 'flux run' appends task ids to, the scheduler empties it
+#define RUN_QUEUE_FILE "run.queue"
+
+// Set up change notifications for the scheduler, returns 0 on success
+int trigger_init();
+
+void trigger_close();
+
+// Match path watches to the loaded tasks (call after every reload)
+void trigger_sync(const Task *tasks, int count);
+
+// Sleep until a trigger fires, a watched file changes, wake_fd becomes readable (-1 for none)
+// or timeout_ms passes
+void trigger_wait(long timeout_ms, int wake_fd);
+
+// Milliseconds until the next debounced path change fires (-1 if none is waiting)
+long trigger_next_ms();
+
+// Get ids of tasks whose triggers fired, returns how many were written to ids
+int trigger_collect(int *ids, int max_ids);
+
+// Put a triggered run back so it's collected again next time (ex. it was deferred)
+void trigger_requeue(int task_id);
+
+// Ask the scheduler to run a task right away (CLI side), returns 0 on success
+int queue_run(int task_id);
+
+#endif